@@ -26,6 +26,8 @@ BuildRequires: %{smartmet_boost}-devel
 BuildRequires: libconfig17-devel
 BuildRequires: mysql++-devel
 BuildRequires: bzip2-devel
+BuildRequires: jsoncpp-devel
+BuildRequires: zlib-devel
 BuildRequires: smartmet-library-calculator-devel >= 26.4.13
 BuildRequires: smartmet-library-textgen-devel >= 26.5.25
 BuildRequires: smartmet-library-spine-devel >= 26.6.24
@@ -39,6 +41,8 @@ Requires: smartmet-library-macgyver >= 26.6.15
 Requires: smartmet-library-locus >= 26.4.13
 Requires: smartmet-library-textgen >= 26.5.25
 Requires: libconfig17
+Requires: jsoncpp
+Requires: zlib
 Requires: smartmet-engine-geonames >= 26.6.24
 Requires: smartmet-engine-querydata >= 26.6.24
 Requires: smartmet-engine-gis >= 26.6.24
@@ -58,7 +62,9 @@ Obsoletes: smartmet-brainstorm-textgenplugin-debuginfo < 16.11.1
 #TestRequires: smartmet-engine-gis >= 26.6.24
 #TestRequires: smartmet-engine-geonames >= 26.6.24
 #TestRequires: smartmet-library-spine-plugin-test >= 26.6.24
+#TestRequires: smartmet-library-regression
 #TestRequires: smartmet-library-newbase-devel >= 26.6.24
+#TestRequires: smartmet-library-gis-devel
 #TestRequires: smartmet-test-data
 #TestRequires: smartmet-test-db
 
@@ -82,6 +88,7 @@ rm -rf $RPM_BUILD_ROOT
 %files
 %defattr(0775,root,root,0775)
 %{_datadir}/smartmet/plugins/%{DIRNAME}.so
+%{_bindir}/textgen-bulk
 
 %changelog
 * Fri Jun 26 2026 Mika Heiskanen <mika.heiskanen@fmi.fi> 26.6.26-1.fmi
@@ -0,0 +1,163 @@
+// ======================================================================
+/*!
+ * \brief Regression tests and a timing of bbox areas
+ */
+// ======================================================================
+
+#include "BBox.h"
+#include <boost/algorithm/string/classification.hpp>
+#include <boost/algorithm/string/split.hpp>
+#include <gis/Box.h>
+#include <gis/OGR.h>
+#include <ogr_geometry.h>
+#include <regression/tframe.h>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace SmartMet::Plugin::Textgen;
+
+namespace
+{
+const std::vector<std::string> boxes = {
+    "24.5,60.0,25.5,60.5", "19.0,59.5,31.5,70.1", "-10.25,35.5,30,72", "25.125,60.25,24.5,59.75"};
+
+// Microseconds per area of each route, printed after the tests
+double bbox_usec = 0;
+double wkt_usec = 0;
+
+std::vector<std::string> split(const std::string& bbox)
+{
+  std::vector<std::string> parts;
+  boost::algorithm::split(parts, bbox, boost::algorithm::is_any_of(","));
+  return parts;
+}
+
+// The path the Geonames engine makes of a WKT polygon
+NFmiSvgPath make_wkt_path(const std::string& wkt)
+{
+  std::unique_ptr<OGRGeometry> geom(Fmi::OGR::createFromWkt(wkt, 4326));
+  std::string svg = Fmi::OGR::exportToSvg(*geom, Fmi::Box::identity(), 6);
+  std::stringstream in(" \"\n" + svg + " \"\n");
+  NFmiSvgPath path;
+  path.Read(in);
+  return path;
+}
+
+std::string compare(const NFmiSvgPath& bbox_path, const NFmiSvgPath& wkt_path)
+{
+  if (bbox_path.size() != wkt_path.size())
+    return std::to_string(bbox_path.size()) + " elements instead of " +
+           std::to_string(wkt_path.size());
+
+  auto it = wkt_path.begin();
+  for (const auto& element : bbox_path)
+  {
+    if (element.itsType != it->itsType || std::abs(element.itsX - it->itsX) > 1e-9 ||
+        std::abs(element.itsY - it->itsY) > 1e-9)
+      return "element " + std::to_string(element.itsX) + "," + std::to_string(element.itsY) +
+             " instead of " + std::to_string(it->itsX) + "," + std::to_string(it->itsY);
+    ++it;
+  }
+  return "";
+}
+
+template <typename F>
+double usec_per_call(int count, F&& f)
+{
+  const auto start = std::chrono::steady_clock::now();
+  std::size_t elements = 0;
+  for (int i = 0; i < count; i++)
+    elements += f(boxes[i % boxes.size()]).size();
+  const auto end = std::chrono::steady_clock::now();
+  if (elements == 0)
+    return 0;
+  return std::chrono::duration<double, std::micro>(end - start).count() / count;
+}
+
+}  // namespace
+
+namespace BBoxTest
+{
+// ----------------------------------------------------------------------
+
+void same_as_wkt()
+{
+  for (const auto& bbox : boxes)
+  {
+    const auto parts = split(bbox);
+    auto err = compare(make_bbox_path(parts), make_wkt_path(make_bbox_wkt(parts)));
+    if (!err.empty())
+      TEST_FAILED("bbox " + bbox + " differs from its WKT polygon: " + err);
+  }
+
+  TEST_PASSED();
+}
+
+// ----------------------------------------------------------------------
+
+void invalid_bbox()
+{
+  try
+  {
+    make_bbox_path(split("24.5,60.0,x,60.5"));
+    TEST_FAILED("A non-numeric coordinate should be rejected");
+  }
+  catch (const tframe::failed&)
+  {
+    throw;
+  }
+  catch (...)
+  {
+  }
+
+  TEST_PASSED();
+}
+
+// ----------------------------------------------------------------------
+
+void timing()
+{
+  // Splitting is common to both routes, the WKT route also includes making
+  // the polygon which the plugin gives to the Geonames engine
+  const int count = 20000;
+  bbox_usec =
+      usec_per_call(count, [](const std::string& bbox) { return make_bbox_path(split(bbox)); });
+  wkt_usec = usec_per_call(
+      count, [](const std::string& bbox) { return make_wkt_path(make_bbox_wkt(split(bbox))); });
+
+  if (bbox_usec >= wkt_usec)
+    TEST_FAILED("Building the bbox directly should be faster than the WKT route");
+
+  TEST_PASSED();
+}
+
+// ----------------------------------------------------------------------
+
+class tests : public tframe::tests
+{
+  const char* error_message_prefix() const override { return "\n\t"; }
+  void test() override
+  {
+    TEST(same_as_wkt);
+    TEST(invalid_bbox);
+    TEST(timing);
+  }
+};
+
+}  // namespace BBoxTest
+
+int main()
+{
+  std::cout << "\nBBox tester\n===========\n";
+  BBoxTest::tests t;
+  const int ret = t.run();
+  std::cout << "bbox area " << bbox_usec << " us, WKT area " << wkt_usec << " us\n";
+  return ret;
+}
+
+// ======================================================================
@@ -0,0 +1,182 @@
+// ======================================================================
+/*!
+ * \brief Regression tests for precompressed texts
+ */
+// ======================================================================
+
+#include "Compression.h"
+#include <regression/tframe.h>
+#include <zlib.h>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace SmartMet::Plugin::Textgen;
+
+namespace
+{
+// Inflate a complete gzip (window_bits 31) or zlib (window_bits 15) stream
+std::string inflate_stream(const std::string& data, int window_bits)
+{
+  z_stream stream{};
+  if (inflateInit2(&stream, window_bits) != Z_OK)
+    throw std::runtime_error("inflateInit2 failed");
+
+  std::string out;
+  char buffer[4096];
+  stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+  stream.avail_in = static_cast<uInt>(data.size());
+
+  int status = Z_OK;
+  while (status == Z_OK)
+  {
+    stream.next_out = reinterpret_cast<Bytef*>(buffer);
+    stream.avail_out = sizeof(buffer);
+    status = inflate(&stream, Z_NO_FLUSH);
+    out.append(buffer, sizeof(buffer) - stream.avail_out);
+  }
+  const bool trailing_garbage = (stream.avail_in != 0);
+  inflateEnd(&stream);
+
+  // Z_STREAM_END is returned only if the trailer checksum and size match
+  if (status != Z_STREAM_END)
+    throw std::runtime_error("inflate failed with status " + std::to_string(status));
+  if (trailing_garbage)
+    throw std::runtime_error("data after the end of the stream");
+  return out;
+}
+
+const std::vector<std::string> texts = {
+    "Sääennuste Helsinkiin keskiviikkona kello 8\n\nOdotettavissa iltaan asti:\n",
+    "",
+    std::string(100000, 'x'),
+    "<p>Päivän ylin lämpötila on 18...20 astetta.</p>\n"};
+
+std::string joined(const std::vector<DeflatedText>& parts, ContentEncoding encoding)
+{
+  std::vector<const DeflatedText*> ptrs;
+  for (const auto& part : parts)
+    ptrs.push_back(&part);
+  return join_deflated(ptrs, encoding);
+}
+
+}  // namespace
+
+namespace CompressionTest
+{
+// ----------------------------------------------------------------------
+
+void join_gzip()
+{
+  std::vector<DeflatedText> parts;
+  std::string expected;
+  for (const auto& text : texts)
+  {
+    parts.push_back(deflate_text(text));
+    expected += text;
+  }
+
+  if (inflate_stream(joined(parts, ContentEncoding::gzip), 31) != expected)
+    TEST_FAILED("Joined gzip stream does not inflate to the joined texts");
+
+  // The same parts in a different order and repeated
+  std::vector<DeflatedText> reordered = {parts[3], parts[0], parts[3], parts[2]};
+  expected = texts[3] + texts[0] + texts[3] + texts[2];
+  if (inflate_stream(joined(reordered, ContentEncoding::gzip), 31) != expected)
+    TEST_FAILED("Reordered gzip stream does not inflate to the joined texts");
+
+  TEST_PASSED();
+}
+
+// ----------------------------------------------------------------------
+
+void join_deflate()
+{
+  std::vector<DeflatedText> parts;
+  std::string expected;
+  for (const auto& text : texts)
+  {
+    parts.push_back(deflate_text(text));
+    expected += text;
+  }
+
+  if (inflate_stream(joined(parts, ContentEncoding::deflate), 15) != expected)
+    TEST_FAILED("Joined zlib stream does not inflate to the joined texts");
+
+  TEST_PASSED();
+}
+
+// ----------------------------------------------------------------------
+
+void join_nothing()
+{
+  const std::vector<DeflatedText> parts;
+  if (!inflate_stream(joined(parts, ContentEncoding::gzip), 31).empty())
+    TEST_FAILED("Empty gzip stream should inflate to nothing");
+  if (!inflate_stream(joined(parts, ContentEncoding::deflate), 15).empty())
+    TEST_FAILED("Empty zlib stream should inflate to nothing");
+
+  try
+  {
+    joined(parts, ContentEncoding::identity);
+    TEST_FAILED("Joining in identity encoding should fail");
+  }
+  catch (const tframe::failed&)
+  {
+    throw;
+  }
+  catch (...)
+  {
+  }
+
+  TEST_PASSED();
+}
+
+// ----------------------------------------------------------------------
+
+void negotiate()
+{
+  if (negotiate_encoding({}) != ContentEncoding::identity)
+    TEST_FAILED("Missing Accept-Encoding should give identity");
+  if (negotiate_encoding(std::string("gzip, deflate")) != ContentEncoding::gzip)
+    TEST_FAILED("gzip should be preferred over deflate of equal quality");
+  if (negotiate_encoding(std::string("gzip;q=0.5, deflate")) != ContentEncoding::deflate)
+    TEST_FAILED("deflate of higher quality should be preferred");
+  if (negotiate_encoding(std::string("GZIP")) != ContentEncoding::gzip)
+    TEST_FAILED("Encoding names should be case insensitive");
+  if (negotiate_encoding(std::string("*")) != ContentEncoding::gzip)
+    TEST_FAILED("Wildcard should accept gzip");
+  if (negotiate_encoding(std::string("*;q=0, deflate")) != ContentEncoding::deflate)
+    TEST_FAILED("Wildcard with zero quality should reject gzip");
+  if (negotiate_encoding(std::string("gzip;q=0, deflate;q=0")) != ContentEncoding::identity)
+    TEST_FAILED("Zero qualities should give identity");
+  if (negotiate_encoding(std::string("br")) != ContentEncoding::identity)
+    TEST_FAILED("Unsupported encodings should give identity");
+
+  TEST_PASSED();
+}
+
+// ----------------------------------------------------------------------
+
+class tests : public tframe::tests
+{
+  const char* error_message_prefix() const override { return "\n\t"; }
+  void test() override
+  {
+    TEST(join_gzip);
+    TEST(join_deflate);
+    TEST(join_nothing);
+    TEST(negotiate);
+  }
+};
+
+}  // namespace CompressionTest
+
+int main()
+{
+  std::cout << "\nCompression tester\n==================\n";
+  CompressionTest::tests t;
+  return t.run();
+}
+
+// ======================================================================
@@ -0,0 +1,200 @@
+// ======================================================================
+/*!
+ * \brief Regression tests for class DiskCache
+ */
+// ======================================================================
+
+#include "DiskCache.h"
+#include <regression/tframe.h>
+#include <unistd.h>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <thread>
+
+using namespace SmartMet::Plugin::Textgen;
+
+namespace
+{
+const std::size_t max_bytes = 8 * 1024 * 1024;
+
+std::filesystem::path directory()
+{
+  return std::filesystem::temp_directory_path() /
+         ("textgen-diskcache-test-" + std::to_string(getpid()));
+}
+
+bool accept_all(const std::string& /*key*/, std::time_t /*stamp*/)
+{
+  return true;
+}
+
+// Texts are written and the index is loaded in the background
+bool wait_for(DiskCache& cache,
+              const std::string& key,
+              const std::optional<std::string>& expected = std::nullopt,
+              int attempts = 500)
+{
+  for (int i = 0; i < attempts; i++)
+  {
+    auto text = cache.find(key);
+    if (text && (!expected || *text == *expected))
+      return true;
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  return false;
+}
+
+// Inserts are ignored until the index has been loaded
+bool wait_until_loaded(DiskCache& cache)
+{
+  for (int i = 0; i < 500; i++)
+  {
+    cache.insert("probe", "probe", 0);
+    if (wait_for(cache, "probe", std::nullopt, 1))
+      return true;
+  }
+  return false;
+}
+
+std::string value(int i)
+{
+  return std::string(1000 + i, static_cast<char>('a' + i % 26));
+}
+
+void write_texts(int count, std::time_t stamp)
+{
+  DiskCache cache(directory(), max_bytes);
+  cache.load(accept_all);
+  wait_until_loaded(cache);
+  for (int i = 0; i < count; i++)
+    cache.insert("key" + std::to_string(i), value(i), stamp);
+  wait_for(cache, "key" + std::to_string(count - 1));
+}
+
+}  // namespace
+
+namespace DiskCacheTest
+{
+// ----------------------------------------------------------------------
+
+void reload()
+{
+  std::filesystem::remove_all(directory());
+  write_texts(100, 1000);
+
+  DiskCache cache(directory(), max_bytes);
+  cache.load(accept_all);
+  if (!wait_for(cache, "key0"))
+    TEST_FAILED("Texts were not loaded");
+
+  for (int i = 0; i < 100; i++)
+  {
+    auto text = cache.find("key" + std::to_string(i));
+    if (!text)
+      TEST_FAILED("key" + std::to_string(i) + " was not loaded");
+    if (*text != value(i))
+      TEST_FAILED("key" + std::to_string(i) + " was loaded with a wrong value");
+  }
+  if (cache.find("key100"))
+    TEST_FAILED("A text which was never inserted was found");
+
+  TEST_PASSED();
+}
+
+// ----------------------------------------------------------------------
+
+void validate_stamps()
+{
+  std::filesystem::remove_all(directory());
+  write_texts(10, 1000);
+  {
+    // Newer texts of some keys
+    DiskCache cache(directory(), max_bytes);
+    cache.load(accept_all);
+    if (!wait_until_loaded(cache))
+      TEST_FAILED("Texts were not loaded");
+    for (int i = 0; i < 5; i++)
+      cache.insert("key" + std::to_string(i), "new" + std::to_string(i), 2000);
+    for (int i = 0; i < 5; i++)
+      if (!wait_for(cache, "key" + std::to_string(i), "new" + std::to_string(i)))
+        TEST_FAILED("Newer text of key" + std::to_string(i) + " was not written");
+  }
+
+  DiskCache cache(directory(), max_bytes);
+  cache.load([](const std::string& /*key*/, std::time_t stamp) { return stamp >= 2000; });
+  if (!wait_for(cache, "key0"))
+    TEST_FAILED("Valid texts were not loaded");
+
+  for (int i = 0; i < 5; i++)
+    if (cache.find("key" + std::to_string(i)) != "new" + std::to_string(i))
+      TEST_FAILED("The newest text of key" + std::to_string(i) + " should have been loaded");
+  for (int i = 5; i < 10; i++)
+    if (cache.find("key" + std::to_string(i)))
+      TEST_FAILED("Rejected key" + std::to_string(i) + " should not have been loaded");
+
+  TEST_PASSED();
+}
+
+// ----------------------------------------------------------------------
+
+void damaged_tail()
+{
+  std::filesystem::remove_all(directory());
+  write_texts(10, 1000);
+
+  // An interrupted write
+  for (const auto& entry : std::filesystem::directory_iterator(directory()))
+  {
+    std::ofstream out(entry.path(), std::ios::binary | std::ios::app);
+    out << "TGC1 partial record";
+  }
+
+  {
+    DiskCache cache(directory(), max_bytes);
+    cache.load(accept_all);
+    if (!wait_for(cache, "key9"))
+      TEST_FAILED("Texts before the damaged record were not loaded");
+    cache.insert("after", "written after the damaged record", 1000);
+    if (!wait_for(cache, "after"))
+      TEST_FAILED("Text inserted after loading was not written");
+  }
+
+  DiskCache cache(directory(), max_bytes);
+  cache.load(accept_all);
+  if (!wait_for(cache, "after"))
+    TEST_FAILED("Damaged tail was not cut off before appending");
+  if (cache.find("key0") != value(0))
+    TEST_FAILED("Text before the damaged record was lost");
+
+  TEST_PASSED();
+}
+
+// ----------------------------------------------------------------------
+
+class tests : public tframe::tests
+{
+  const char* error_message_prefix() const override { return "\n\t"; }
+  void test() override
+  {
+    TEST(reload);
+    TEST(validate_stamps);
+    TEST(damaged_tail);
+  }
+};
+
+}  // namespace DiskCacheTest
+
+int main()
+{
+  std::cout << "\nDiskCache tester\n================\n";
+  DiskCacheTest::tests t;
+  const int ret = t.run();
+  std::filesystem::remove_all(directory());
+  return ret;
+}
+
+// ======================================================================
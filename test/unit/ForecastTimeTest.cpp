@@ -0,0 +1,109 @@
+// ======================================================================
+/*!
+ * \brief Regression tests for forecast times of requests
+ */
+// ======================================================================
+
+#include "ForecastTime.h"
+#include <regression/tframe.h>
+#include <iostream>
+#include <string>
+
+using namespace SmartMet::Plugin::Textgen;
+
+namespace
+{
+// 2008-08-06 08:00:00 UTC
+const std::time_t hour = 1218009600;
+
+std::string str(std::time_t t)
+{
+  return std::to_string(static_cast<long long>(t));
+}
+
+}  // namespace
+
+namespace ForecastTimeTest
+{
+// ----------------------------------------------------------------------
+
+void round_to_resolution()
+{
+  // 08:17:42 is made for 08:10 with 10 minutes and for 08:17 with a minute
+  const std::time_t t = hour + 17 * 60 + 42;
+  if (round_forecasttime(t, 600) != hour + 10 * 60)
+    TEST_FAILED("Rounding to 10 minutes gave " + str(round_forecasttime(t, 600)));
+  if (round_forecasttime(t, 60) != hour + 17 * 60)
+    TEST_FAILED("Rounding to a minute gave " + str(round_forecasttime(t, 60)));
+  if (round_forecasttime(t, 3600) != hour)
+    TEST_FAILED("Rounding to an hour gave " + str(round_forecasttime(t, 3600)));
+
+  TEST_PASSED();
+}
+
+// ----------------------------------------------------------------------
+
+void boundaries()
+{
+  if (round_forecasttime(hour, 600) != hour)
+    TEST_FAILED("A time on the boundary should not change");
+  if (round_forecasttime(hour - 1, 600) != hour - 600)
+    TEST_FAILED("A second before the boundary belongs to the previous interval");
+
+  TEST_PASSED();
+}
+
+// ----------------------------------------------------------------------
+
+void exact_time()
+{
+  const std::time_t t = hour + 17 * 60 + 42;
+  if (round_forecasttime(t, 1) != t)
+    TEST_FAILED("A resolution of one second should keep the time");
+
+  TEST_PASSED();
+}
+
+// ----------------------------------------------------------------------
+
+void seconds_until_next()
+{
+  const std::time_t t = hour + 17 * 60 + 42;
+  if (seconds_until_next_forecasttime(t, 600) != 138)
+    TEST_FAILED("Expected 138 seconds until 08:20, got " +
+                std::to_string(seconds_until_next_forecasttime(t, 600)));
+  if (seconds_until_next_forecasttime(t, 60) != 18)
+    TEST_FAILED("Expected 18 seconds until 08:18, got " +
+                std::to_string(seconds_until_next_forecasttime(t, 60)));
+  if (seconds_until_next_forecasttime(hour, 600) != 600)
+    TEST_FAILED("On the boundary the whole interval should be left");
+  if (seconds_until_next_forecasttime(t, 1) != 1)
+    TEST_FAILED("The exact time changes every second");
+
+  TEST_PASSED();
+}
+
+// ----------------------------------------------------------------------
+
+class tests : public tframe::tests
+{
+  const char* error_message_prefix() const override { return "\n\t"; }
+  void test() override
+  {
+    TEST(round_to_resolution);
+    TEST(boundaries);
+    TEST(exact_time);
+    TEST(seconds_until_next);
+  }
+};
+
+}  // namespace ForecastTimeTest
+
+int main()
+{
+  std::cout << "\nForecastTime tester\n===================\n";
+  ForecastTimeTest::tests t;
+  return t.run();
+}
+
+// ======================================================================
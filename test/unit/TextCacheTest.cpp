@@ -0,0 +1,189 @@
+// ======================================================================
+/*!
+ * \brief Regression tests for class TextCache
+ */
+// ======================================================================
+
+#include "TextCache.h"
+#include <regression/tframe.h>
+#include <iostream>
+#include <string>
+
+using namespace SmartMet::Plugin::Textgen;
+
+namespace
+{
+const TextKeyPrefix prefix("product", "fi", "plain", "forecasttime;");
+
+TextKey key(const std::string& area)
+{
+  return prefix.key(area, false);
+}
+
+TextPtr text(std::size_t size)
+{
+  return make_text(std::string(size, 'x'), 0, false);
+}
+
+// Bytes the cache charges for a text, see TextCache::insert
+std::size_t charge(const std::string& area, std::size_t size)
+{
+  return key(area).size() + size + 128;
+}
+
+}  // namespace
+
+namespace TextCacheTest
+{
+// ----------------------------------------------------------------------
+
+void cheap_large_text_evicted_first()
+{
+  TextCache cache(1);
+  cache.resize(charge("small", 100) + charge("large", 5000) + charge("new", 1000) - 1);
+
+  cache.insert(key("small"), text(100), 1.0);
+  cache.insert(key("large"), text(5000), 1.0);
+  cache.insert(key("new"), text(1000), 1.0);
+
+  if (cache.find(key("large")))
+    TEST_FAILED("The large text has the lowest cost per byte and should have been evicted");
+  if (!cache.find(key("small")))
+    TEST_FAILED("The small text should have been kept");
+  if (!cache.find(key("new")))
+    TEST_FAILED("The new text should have been kept");
+
+  TEST_PASSED();
+}
+
+// ----------------------------------------------------------------------
+
+void slow_text_kept()
+{
+  TextCache cache(1);
+  cache.resize(2 * charge("a", 1000) + 10);
+
+  cache.insert(key("slow"), text(1000), 10.0);
+  cache.insert(key("fast1"), text(1000), 0.01);
+  cache.insert(key("fast2"), text(1000), 0.01);
+
+  if (!cache.find(key("slow")))
+    TEST_FAILED("The slowly generated text should have been kept");
+  if (cache.find(key("fast1")))
+    TEST_FAILED("The older fast text should have been evicted");
+  if (!cache.find(key("fast2")))
+    TEST_FAILED("The newest text should have been kept");
+
+  TEST_PASSED();
+}
+
+// ----------------------------------------------------------------------
+
+void unused_text_ages_out()
+{
+  // Each eviction raises the priority of new texts, after a few hundred
+  // evictions they pass the priority of the slow text
+  TextCache cache(1);
+  cache.resize(2 * charge("a", 1000) + 10);
+
+  cache.insert(key("slow"), text(1000), 1.0);
+  for (int i = 0; i < 1000; i++)
+    cache.insert(key("fast" + std::to_string(i)), text(1000), 0.01);
+
+  if (cache.find(key("slow")))
+    TEST_FAILED("The unused text should have aged out");
+
+  TEST_PASSED();
+}
+
+// ----------------------------------------------------------------------
+
+void used_text_stays()
+{
+  TextCache cache(1);
+  cache.resize(2 * charge("a", 1000) + 10);
+
+  cache.insert(key("used"), text(1000), 0.02);
+  for (int i = 0; i < 1000; i++)
+  {
+    if (!cache.find(key("used")))
+      TEST_FAILED("The text used after each insert should stay in the cache");
+    cache.insert(key("fast" + std::to_string(i)), text(1000), 0.01);
+  }
+
+  TEST_PASSED();
+}
+
+// ----------------------------------------------------------------------
+
+void byte_limit()
+{
+  TextCache cache(4);
+  const std::size_t limit = 100 * charge("a", 1000);
+  cache.resize(limit);
+
+  for (int i = 0; i < 1000; i++)
+    cache.insert(key(std::to_string(i)), text(1000), 1.0);
+
+  const auto bytes = cache.byteStatistics();
+  if (bytes.size > limit)
+    TEST_FAILED("Cache size " + std::to_string(bytes.size) + " exceeds the limit " +
+                std::to_string(limit));
+  if (bytes.maxsize > limit)
+    TEST_FAILED("Byte limits of the shards exceed the limit");
+  if (bytes.maxsize == 0 || cache.statistics().maxsize != bytes.maxsize)
+    TEST_FAILED("Maximum size should be the byte limit");
+
+  // A text larger than a shard is not cached at all
+  cache.insert(key("huge"), text(limit), 1.0);
+  if (cache.find(key("huge")))
+    TEST_FAILED("A text larger than the shard should not be cached");
+
+  TEST_PASSED();
+}
+
+// ----------------------------------------------------------------------
+
+void replace_text()
+{
+  TextCache cache(1);
+  cache.resize(10 * charge("a", 1000));
+
+  cache.insert(key("a"), make_text("first", 0, false), 1.0);
+  cache.insert(key("a"), make_text("second", 0, false), 1.0);
+
+  auto value = cache.find(key("a"));
+  if (!value || value->text != "second")
+    TEST_FAILED("The text should have been replaced");
+  if (cache.statistics().size != 1)
+    TEST_FAILED("Replacing a text should not add an entry");
+
+  TEST_PASSED();
+}
+
+// ----------------------------------------------------------------------
+
+class tests : public tframe::tests
+{
+  const char* error_message_prefix() const override { return "\n\t"; }
+  void test() override
+  {
+    TEST(cheap_large_text_evicted_first);
+    TEST(slow_text_kept);
+    TEST(unused_text_ages_out);
+    TEST(used_text_stays);
+    TEST(byte_limit);
+    TEST(replace_text);
+  }
+};
+
+}  // namespace TextCacheTest
+
+int main()
+{
+  std::cout << "\nTextCache tester\n================\n";
+  TextCacheTest::tests t;
+  return t.run();
+}
+
+// ======================================================================
@@ -0,0 +1,97 @@
+// ======================================================================
+/*!
+ * \brief Implementation of class AreaIndex
+ */
+// ======================================================================
+
+#include "AreaIndex.h"
+#include <macgyver/Exception.h>
+#include <newbase/NFmiPoint.h>
+#include <newbase/NFmiSvgPath.h>
+#include <algorithm>
+#include <iterator>
+#include <limits>
+
+namespace SmartMet
+{
+namespace Plugin
+{
+namespace Textgen
+{
+AreaIndex::AreaIndex(std::vector<Area> areas, std::string areasource)
+    : itsAreas(std::move(areas)), itsAreaSource(std::move(areasource))
+{
+  try
+  {
+    std::vector<Value> values;
+    values.reserve(itsAreas.size());
+
+    for (std::size_t i = 0; i < itsAreas.size(); i++)
+    {
+      const auto& area = itsAreas[i].second;
+      if (area.isPoint())
+        continue;
+
+      double minx = std::numeric_limits<double>::max();
+      double miny = std::numeric_limits<double>::max();
+      double maxx = std::numeric_limits<double>::lowest();
+      double maxy = std::numeric_limits<double>::lowest();
+      for (const auto& element : area.path())
+      {
+        // Close path elements carry no coordinates
+        if (element.itsType != NFmiSvgPath::kElementMoveto &&
+            element.itsType != NFmiSvgPath::kElementLineto)
+          continue;
+        minx = std::min(minx, element.itsX);
+        miny = std::min(miny, element.itsY);
+        maxx = std::max(maxx, element.itsX);
+        maxy = std::max(maxy, element.itsY);
+      }
+
+      if (minx <= maxx)
+        values.emplace_back(Box(Point(minx, miny), Point(maxx, maxy)), i);
+    }
+
+    // The areas do not change, so the tree is bulk loaded once
+    itsTree = decltype(itsTree)(values.begin(), values.end());
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+const AreaIndex::Area* AreaIndex::find(double lon, double lat) const
+{
+  try
+  {
+    std::vector<Value> candidates;
+    itsTree.query(boost::geometry::index::intersects(Point(lon, lat)),
+                  std::back_inserter(candidates));
+
+    // Nested areas are resolved by the configured order
+    std::sort(candidates.begin(),
+              candidates.end(),
+              [](const Value& a, const Value& b) { return a.second < b.second; });
+
+    const NFmiPoint point(lon, lat);
+    for (const auto& candidate : candidates)
+    {
+      const Area& area = itsAreas[candidate.second];
+      if (area.second.path().IsInside(point))
+        return &area;
+    }
+
+    return nullptr;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+}  // namespace Textgen
+}  // namespace Plugin
+}  // namespace SmartMet
+
+// ======================================================================
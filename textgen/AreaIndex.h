@@ -0,0 +1,60 @@
+// ======================================================================
+/*!
+ * \brief Spatial index of configured areas for point locations
+ *
+ * Points inside a configured area are given the forecast of the area
+ * instead of a forecast of their own, so all of them share the cached
+ * text of the area. The bounding boxes of the areas are kept in an
+ * R-tree and only the candidates found in it are tested exactly.
+ */
+// ======================================================================
+
+#pragma once
+
+#include <boost/geometry.hpp>
+#include <boost/geometry/index/rtree.hpp>
+#include <calculator/WeatherArea.h>
+#include <cstddef>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace SmartMet
+{
+namespace Plugin
+{
+namespace Textgen
+{
+class AreaIndex
+{
+ public:
+  // Area id and area
+  using Area = std::pair<std::string, TextGen::WeatherArea>;
+
+  AreaIndex(std::vector<Area> areas, std::string areasource);
+  AreaIndex(const AreaIndex& other) = delete;
+  AreaIndex& operator=(const AreaIndex& other) = delete;
+
+  // The first configured area containing the point, nullptr if there is none
+  const Area* find(double lon, double lat) const;
+
+  std::size_t size() const { return itsAreas.size(); }
+
+  // The areas are used only by requests with the same areasource parameter
+  const std::string& areaSource() const { return itsAreaSource; }
+
+ private:
+  using Point = boost::geometry::model::point<double, 2, boost::geometry::cs::cartesian>;
+  using Box = boost::geometry::model::box<Point>;
+  using Value = std::pair<Box, std::size_t>;  // bounding box and index to itsAreas
+
+  std::vector<Area> itsAreas;
+  std::string itsAreaSource;
+  boost::geometry::index::rtree<Value, boost::geometry::index::rstar<16>> itsTree;
+};
+
+}  // namespace Textgen
+}  // namespace Plugin
+}  // namespace SmartMet
+
+// ======================================================================
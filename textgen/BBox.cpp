@@ -0,0 +1,80 @@
+// ======================================================================
+/*!
+ * \brief Implementation of bbox rectangles
+ */
+// ======================================================================
+
+#include "BBox.h"
+#include <boost/algorithm/string/trim.hpp>
+#include <macgyver/Exception.h>
+#include <macgyver/StringConversion.h>
+
+namespace SmartMet
+{
+namespace Plugin
+{
+namespace Textgen
+{
+// ----------------------------------------------------------------------
+/*!
+ * \brief The WKT polygon of a bbox
+ */
+// ----------------------------------------------------------------------
+
+std::string make_bbox_wkt(const std::vector<std::string>& parts)
+{
+  try
+  {
+    std::string wktString("POLYGON((");
+    wktString += (parts[0] + " " + parts[1] + ", ");
+    wktString += (parts[0] + " " + parts[3] + ", ");
+    wktString += (parts[2] + " " + parts[3] + ", ");
+    wktString += (parts[2] + " " + parts[1] + ", ");
+    wktString += (parts[0] + " " + parts[1] + "))");
+    return wktString;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Build the path of a bbox without a WKT round trip
+ *
+ * The path is identical to the one the Geonames engine would make of the
+ * WKT polygon of the bbox.
+ */
+// ----------------------------------------------------------------------
+
+NFmiSvgPath make_bbox_path(const std::vector<std::string>& parts)
+{
+  try
+  {
+    const double lon1 = Fmi::stod(boost::algorithm::trim_copy(parts[0]));
+    const double lat1 = Fmi::stod(boost::algorithm::trim_copy(parts[1]));
+    const double lon2 = Fmi::stod(boost::algorithm::trim_copy(parts[2]));
+    const double lat2 = Fmi::stod(boost::algorithm::trim_copy(parts[3]));
+
+    // Same corner order as in the WKT polygon
+    NFmiSvgPath path;
+    path.push_back(NFmiSvgPath::Element(NFmiSvgPath::kElementMoveto, lon1, lat1));
+    path.push_back(NFmiSvgPath::Element(NFmiSvgPath::kElementLineto, lon1, lat2));
+    path.push_back(NFmiSvgPath::Element(NFmiSvgPath::kElementLineto, lon2, lat2));
+    path.push_back(NFmiSvgPath::Element(NFmiSvgPath::kElementLineto, lon2, lat1));
+    path.push_back(NFmiSvgPath::Element(NFmiSvgPath::kElementLineto, lon1, lat1));
+    path.push_back(NFmiSvgPath::Element(NFmiSvgPath::kElementClosePath, lon1, lat1));
+    return path;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Invalid bbox parameter");
+  }
+}
+
+}  // namespace Textgen
+}  // namespace Plugin
+}  // namespace SmartMet
+
+// ======================================================================
@@ -0,0 +1,33 @@
+// ======================================================================
+/*!
+ * \brief Rectangles of bbox parameters
+ *
+ * A bbox without a radius is built into a path directly instead of being
+ * converted into a WKT polygon, which the Geonames engine would parse
+ * with GDAL, export as SVG and parse again into the same path.
+ */
+// ======================================================================
+
+#pragma once
+
+#include <newbase/NFmiSvgPath.h>
+#include <string>
+#include <vector>
+
+namespace SmartMet
+{
+namespace Plugin
+{
+namespace Textgen
+{
+// The WKT polygon lon1 lat1, lon1 lat2, lon2 lat2, lon2 lat1, lon1 lat1
+std::string make_bbox_wkt(const std::vector<std::string>& parts);
+
+// The path of the WKT polygon, parts are lon1,lat1,lon2,lat2
+NFmiSvgPath make_bbox_path(const std::vector<std::string>& parts);
+
+}  // namespace Textgen
+}  // namespace Plugin
+}  // namespace SmartMet
+
+// ======================================================================
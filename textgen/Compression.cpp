@@ -0,0 +1,214 @@
+// ======================================================================
+/*!
+ * \brief Implementation of precompressed texts
+ */
+// ======================================================================
+
+#include "Compression.h"
+#include <boost/algorithm/string.hpp>
+#include <macgyver/Exception.h>
+#include <zlib.h>
+
+namespace SmartMet
+{
+namespace Plugin
+{
+namespace Textgen
+{
+namespace
+{
+// Final empty block with fixed Huffman codes
+const char final_block[] = {0x03, 0x00};
+
+const char gzip_header[] = {
+    '\x1f', '\x8b', '\x08', '\x00', '\x00', '\x00', '\x00', '\x00', '\x00', '\xff'};
+
+// Deflate with a 32K window and the default compression level
+const char zlib_header[] = {'\x78', '\x9c'};
+
+void append_le32(std::string& out, std::uint32_t value)
+{
+  for (int i = 0; i < 4; i++)
+    out += static_cast<char>((value >> (8 * i)) & 0xff);
+}
+
+void append_be32(std::string& out, std::uint32_t value)
+{
+  for (int i = 3; i >= 0; i--)
+    out += static_cast<char>((value >> (8 * i)) & 0xff);
+}
+
+// Quality of an encoding in an Accept-Encoding header, 0 if not acceptable
+double encoding_quality(const std::string& accept_encoding, const std::string& name)
+{
+  std::optional<double> quality;
+  std::optional<double> wildcard_quality;
+
+  std::vector<std::string> codings;
+  boost::algorithm::split(codings, accept_encoding, boost::algorithm::is_any_of(","));
+  for (const auto& coding : codings)
+  {
+    std::vector<std::string> parts;
+    boost::algorithm::split(parts, coding, boost::algorithm::is_any_of(";"));
+    const std::string coding_name = boost::algorithm::trim_copy(parts[0]);
+
+    double q = 1;
+    for (std::size_t i = 1; i < parts.size(); i++)
+    {
+      const std::string param = boost::algorithm::trim_copy(parts[i]);
+      if (boost::algorithm::istarts_with(param, "q="))
+      {
+        try
+        {
+          q = std::stod(param.substr(2));
+        }
+        catch (...)
+        {
+          q = 0;
+        }
+      }
+    }
+
+    if (boost::algorithm::iequals(coding_name, name))
+      quality = q;
+    else if (coding_name == "*")
+      wildcard_quality = q;
+  }
+
+  if (quality)
+    return *quality;
+  return wildcard_quality.value_or(0);
+}
+
+}  // namespace
+
+DeflatedText deflate_text(const std::string& text)
+{
+  try
+  {
+    DeflatedText ret;
+    ret.size = text.size();
+    const auto* input = reinterpret_cast<const Bytef*>(text.data());
+    ret.crc32 = crc32(0, input, static_cast<uInt>(text.size()));
+    ret.adler32 = adler32(1, input, static_cast<uInt>(text.size()));
+
+    z_stream stream{};
+    if (deflateInit2(
+            &stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+      throw Fmi::Exception(BCP, "Failed to initialize deflate");
+
+    // A sync flush ends the stream at a byte boundary without marking the last block final
+    ret.data.resize(deflateBound(&stream, text.size()) + 16);
+    stream.next_in = const_cast<Bytef*>(input);
+    stream.avail_in = static_cast<uInt>(text.size());
+    stream.next_out = reinterpret_cast<Bytef*>(&ret.data[0]);
+    stream.avail_out = static_cast<uInt>(ret.data.size());
+
+    const int status = deflate(&stream, Z_SYNC_FLUSH);
+    const std::size_t compressed_size = stream.total_out;
+    const bool complete = (stream.avail_in == 0 && stream.avail_out > 0);
+    deflateEnd(&stream);
+
+    if (status != Z_OK || !complete)
+      throw Fmi::Exception(BCP, "Failed to deflate text");
+
+    ret.data.resize(compressed_size);
+    ret.data.shrink_to_fit();
+    return ret;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+std::string join_deflated(const std::vector<const DeflatedText*>& parts,
+                          ContentEncoding encoding)
+{
+  try
+  {
+    std::size_t total_size = 0;
+    std::size_t compressed_size = 0;
+    std::uint32_t crc = 0;
+    std::uint32_t adler = 1;
+    for (const auto* part : parts)
+    {
+      crc = crc32_combine(crc, part->crc32, static_cast<z_off_t>(part->size));
+      adler = adler32_combine(adler, part->adler32, static_cast<z_off_t>(part->size));
+      total_size += part->size;
+      compressed_size += part->data.size();
+    }
+
+    std::string out;
+    out.reserve(sizeof(gzip_header) + compressed_size + sizeof(final_block) + 8);
+
+    if (encoding == ContentEncoding::gzip)
+      out.append(gzip_header, sizeof(gzip_header));
+    else if (encoding == ContentEncoding::deflate)
+      out.append(zlib_header, sizeof(zlib_header));
+    else
+      throw Fmi::Exception(BCP, "Texts can be joined only in gzip or deflate encoding");
+
+    for (const auto* part : parts)
+      out += part->data;
+    out.append(final_block, sizeof(final_block));
+
+    if (encoding == ContentEncoding::gzip)
+    {
+      append_le32(out, crc);
+      append_le32(out, static_cast<std::uint32_t>(total_size));  // modulo 2^32
+    }
+    else
+    {
+      append_be32(out, adler);
+    }
+
+    return out;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+ContentEncoding negotiate_encoding(const std::optional<std::string>& accept_encoding)
+{
+  try
+  {
+    if (!accept_encoding)
+      return ContentEncoding::identity;
+
+    const double gzip_quality = encoding_quality(*accept_encoding, "gzip");
+    const double deflate_quality = encoding_quality(*accept_encoding, "deflate");
+
+    if (gzip_quality > 0 && gzip_quality >= deflate_quality)
+      return ContentEncoding::gzip;
+    if (deflate_quality > 0)
+      return ContentEncoding::deflate;
+    return ContentEncoding::identity;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+const char* encoding_name(ContentEncoding encoding)
+{
+  switch (encoding)
+  {
+    case ContentEncoding::gzip:
+      return "gzip";
+    case ContentEncoding::deflate:
+      return "deflate";
+    case ContentEncoding::identity:
+      break;
+  }
+  return "identity";
+}
+
+}  // namespace Textgen
+}  // namespace Plugin
+}  // namespace SmartMet
+
+// ======================================================================
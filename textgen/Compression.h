@@ -0,0 +1,58 @@
+// ======================================================================
+/*!
+ * \brief Precompressed texts for gzip and deflate content encodings
+ *
+ * A response is the concatenation of the texts of its areas, so each text
+ * is compressed separately into a raw deflate stream which ends at a byte
+ * boundary without a final block. The streams of any texts can then be
+ * joined into a valid gzip or zlib stream of the whole response by adding
+ * a header, a final empty block and a trailer whose checksum is combined
+ * from the checksums of the texts. No compression is done per request.
+ */
+// ======================================================================
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace SmartMet
+{
+namespace Plugin
+{
+namespace Textgen
+{
+enum class ContentEncoding
+{
+  identity,
+  gzip,
+  deflate
+};
+
+struct DeflatedText
+{
+  std::string data;      // raw deflate blocks, not final
+  std::size_t size = 0;  // of the uncompressed text
+  std::uint32_t crc32 = 0;
+  std::uint32_t adler32 = 1;
+};
+
+DeflatedText deflate_text(const std::string& text);
+
+// Join the parts of a response into a complete stream of the given encoding
+std::string join_deflated(const std::vector<const DeflatedText*>& parts,
+                          ContentEncoding encoding);
+
+// The preferred encoding of an Accept-Encoding header
+ContentEncoding negotiate_encoding(const std::optional<std::string>& accept_encoding);
+
+const char* encoding_name(ContentEncoding encoding);
+
+}  // namespace Textgen
+}  // namespace Plugin
+}  // namespace SmartMet
+
+// ======================================================================
@@ -5,6 +5,7 @@
 // ======================================================================
 
 #include "Config.h"
+#include "TextKey.h"
 #include <boost/algorithm/string.hpp>
 #include <boost/algorithm/string/replace.hpp>
 #include <boost/lexical_cast.hpp>
@@ -19,6 +20,8 @@
 #include <spine/ConfigTools.h>
 #include <spine/Convenience.h>
 #include <spine/Exceptions.h>
+#include <algorithm>
+#include <atomic>
 #include <filesystem>
 #include <iostream>
 #include <memory>
@@ -30,7 +33,22 @@ namespace Plugin
 {
 namespace Textgen
 {
-#define DEFAULT_FORECAST_TEXT_CACHE_SIZE 20
+#define DEFAULT_FORECAST_TEXT_CACHE_SIZE_MB 64
+// Assumed average size of a text when the cache size is given in texts
+#define LEGACY_FORECAST_TEXT_SIZE (64 * 1024)
+#define DEFAULT_DOCUMENT_CACHE_SIZE 20
+#define DEFAULT_WKT_CACHE_SIZE 1000
+#define DEFAULT_LOCATION_CACHE_SIZE 1000
+#define DEFAULT_MAX_PARALLEL_AREAS 4
+#define DEFAULT_AREA_THREADS 8
+#define DEFAULT_MAX_PARALLEL_JOBS 4
+#define DEFAULT_MAX_BATCH_JOBS 10000
+#define DEFAULT_DISK_CACHE_SIZE_MB 1024
+#define DEFAULT_MIN_FRESHNESS 60
+#define DEFAULT_MAX_FRESHNESS 3600
+#define DEFAULT_FORECASTTIME_RESOLUTION 60
+#define DEFAULT_REFRESH_THREADS 2
+#define DEFAULT_REFRESH_QUEUE_SIZE 1000
 
 namespace
 {
@@ -45,6 +63,9 @@ const char* default_filedictionaries = "";
 const char* default_timezone = "Europe/Helsinki";
 const char* default_textgen_config_name = "default";
 
+// Source of GeometryCache generations
+std::atomic<std::size_t> geometry_generations{0};
+
 void error(Fmi::DirectoryMonitor::Watcher /*id*/,
            const std::filesystem::path& dir,
            const boost::regex& /*pattern*/,
@@ -61,43 +82,41 @@ void error(Fmi::DirectoryMonitor::Watcher /*id*/,
   }
 }
 
-TextGen::WeatherArea make_area(const std::string& postGISName,
-                               const std::unique_ptr<Engine::Gis::GeometryStorage>& geometryStorage)
+// Mask files are given as path or path:layer
+std::string mask_filename(const std::string& value)
 {
-  try
-  {
-    std::string areaName(postGISName);
-    Engine::Gis::normalize_string(areaName);
-
-    if (geometryStorage->isPolygon(postGISName))
-    {
-      std::stringstream svg_string_stream(geometryStorage->getSVGPath(postGISName));
-      NFmiSvgPath svgPath;
-      svgPath.Read(svg_string_stream);
-      return {svgPath, areaName};
-    }
-
-    // if not polygon, it must be a point
-    std::pair<float, float> std_point(geometryStorage->getPoint(postGISName));
-    NFmiPoint point(std_point.first, std_point.second);
-    return {point, areaName};
-  }
-  catch (...)
-  {
-    throw Fmi::Exception::Trace(BCP, "Operation failed!");
-  }
+  return value.substr(0, value.find(':'));
 }
 
-std::vector<std::string> getProductNames(const std::unique_ptr<ProductConfigMap>& pgs)
+WeatherAreas readMasks(const GeometryCache& geometries, const ProductConfig& config)
 {
   try
   {
-    std::vector<std::string> retval;
+    WeatherAreas prod_mask;
+    for (unsigned int i = 0; i < config.numberOfMasks(); i++)
+    {
+      std::string name(config.getMask(i).first);
+      std::string value(config.getMask(i).second);
 
-    for (const auto& pci : *pgs)
-      retval.push_back(pci.first);
+      Fmi::AsyncTask::interruption_point();
 
-    return retval;
+      // first check if mask can be found in PostGIS database
+      if (geometries.storage().geoObjectExists(value))
+      {
+        std::string areaName(value);
+        Engine::Gis::normalize_string(areaName);
+        prod_mask.insert(make_pair(name, geometries.makeArea(value, areaName)));
+      }
+      else
+      {
+        // mask is probably a svg-file
+        if (NFmiFileSystem::FileExists(mask_filename(value)))
+        {
+          prod_mask.insert(make_pair(name, TextGen::WeatherArea(value, name)));
+        }
+      }
+    }
+    return prod_mask;
   }
   catch (...)
   {
@@ -105,55 +124,35 @@ std::vector<std::string> getProductNames(const std::unique_ptr<ProductConfigMap>
   }
 }
 
-std::unique_ptr<ProductWeatherAreaMap> readMasks(
-    const std::unique_ptr<Engine::Gis::GeometryStorage>& gs,
-    const std::unique_ptr<ProductConfigMap>& pgs)
+// Only polygons can contain points, unknown names are ignored like unknown masks
+std::shared_ptr<const AreaIndex> makePointAreaIndex(const GeometryCache& geometries,
+                                                    const ProductConfig& config)
 {
   try
   {
-    auto newProductMasks = std::unique_ptr<ProductWeatherAreaMap>(new ProductWeatherAreaMap());
-
-    // PostGIS
-    std::vector<std::string> product_names(getProductNames(pgs));
-    for (const auto& product_name : product_names)
-    {
-      if (pgs->find(product_name) == pgs->end())
-        throw Fmi::Exception(BCP, product_name + " configuration not found!");
-
-      const ProductConfig& config = *(pgs->at(product_name));
-
-      // masks
-      WeatherAreas prod_mask;
-      for (unsigned int i = 0; i < config.numberOfMasks(); i++)
-      {
-        std::string name(config.getMask(i).first);
-        std::string value(config.getMask(i).second);
+    if (config.getPointAreas().empty())
+      return {};
 
-        Fmi::AsyncTask::interruption_point();
+    const std::string& areasource = config.getPointAreaSource();
 
-        // first check if mask can be found in PostGIS database
-        if (gs->geoObjectExists(value))
-        {
-          prod_mask.insert(make_pair(name, TextGen::WeatherArea(make_area(value, gs))));
-        }
-        else
-        {
-          std::string filename(value);
-          if (filename.find(':') != std::string::npos)
-            filename = filename.substr(0, filename.find(':'));
-          // mask is probably a svg-file
-          if (NFmiFileSystem::FileExists(filename))
-          {
-            prod_mask.insert(make_pair(name, TextGen::WeatherArea(value, name)));
-          }
-        }
-      }
-      newProductMasks->insert(make_pair(product_name, prod_mask));
+    std::vector<AreaIndex::Area> areas;
+    for (const auto& name : config.getPointAreas())
+    {
+      Fmi::AsyncTask::interruption_point();
+
+      std::string areaName(name);
+      std::string shapeKey(name + areasource);
+      Engine::Gis::normalize_string(areaName);
+      Engine::Gis::normalize_string(shapeKey);
+      if (!geometries.storage().geoObjectExists(shapeKey) ||
+          !geometries.storage().isPolygon(shapeKey))
+        continue;
+
+      // Same id and area as when the point is resolved to the area by the Geonames engine
+      areas.emplace_back(name + areasource + "_place1", geometries.makeArea(shapeKey, areaName));
     }
 
-    Fmi::AsyncTask::interruption_point();
-
-    return newProductMasks;
+    return std::make_shared<const AreaIndex>(std::move(areas), areasource);
   }
   catch (...)
   {
@@ -161,6 +160,37 @@ std::unique_ptr<ProductWeatherAreaMap> readMasks(
   }
 }
 
+// True if any of the mask files of the product is among the given files
+bool masksChanged(const ProductConfig& config, const std::set<std::string>& files)
+{
+  for (const auto& mask : config.getMasks())
+    if (files.find(mask_filename(mask.second)) != files.end())
+      return true;
+  return false;
+}
+
+// True if the products are the same compiled instances as before, i.e. none of
+// their configuration files has changed
+bool sameProducts(const ProductConfigMap& products, const ProductConfigMap& previous)
+{
+  return std::equal(products.begin(),
+                    products.end(),
+                    previous.begin(),
+                    previous.end(),
+                    [](const auto& a, const auto& b)
+                    { return a.first == b.first && a.second == b.second; });
+}
+
+std::set<std::string> changedFiles(const std::set<std::string>& deletedFiles,
+                                   const std::set<std::string>& modifiedFiles,
+                                   const std::set<std::string>& newFiles)
+{
+  std::set<std::string> ret(deletedFiles);
+  ret.insert(modifiedFiles.begin(), modifiedFiles.end());
+  ret.insert(newFiles.begin(), newFiles.end());
+  return ret;
+}
+
 void parseConfigurationItem(const libconfig::Config& itsConfig,
                             const std::string& key,
                             const std::vector<std::string>& allowed_sections,
@@ -379,7 +409,18 @@ void parseTypeStringConfiguationItem(const libconfig::Config& itsConfig,
 
 Config::Config(std::string configfile)
     : itsDefaultUrl(default_url),
-      itsForecastTextCacheSize(DEFAULT_FORECAST_TEXT_CACHE_SIZE),
+      itsDocumentCacheSize(DEFAULT_DOCUMENT_CACHE_SIZE),
+      itsWktCacheSize(DEFAULT_WKT_CACHE_SIZE),
+      itsLocationCacheSize(DEFAULT_LOCATION_CACHE_SIZE),
+      itsMaxParallelAreas(DEFAULT_MAX_PARALLEL_AREAS),
+      itsAreaThreads(DEFAULT_AREA_THREADS),
+      itsMaxParallelJobs(DEFAULT_MAX_PARALLEL_JOBS),
+      itsMaxBatchJobs(DEFAULT_MAX_BATCH_JOBS),
+      itsRefreshThreads(DEFAULT_REFRESH_THREADS),
+      itsRefreshQueueSize(DEFAULT_REFRESH_QUEUE_SIZE),
+      itsForecastTimeResolution(DEFAULT_FORECASTTIME_RESOLUTION),
+      itsMinFreshness(DEFAULT_MIN_FRESHNESS),
+      itsMaxFreshness(DEFAULT_MAX_FRESHNESS),
       itsMainConfigFile(std::move(configfile))
 {
 }
@@ -424,7 +465,59 @@ void Config::init(SmartMet::Engine::Gis::Engine* pGisEngine)
     lconf.readFile(itsMainConfigFile.c_str());
     Spine::expandVariables(lconf);
 
-    lconf.lookupValue("forecast_text_cache_size", itsForecastTextCacheSize);
+    // Formatted texts are limited by bytes since their sizes vary a lot
+    unsigned int forecast_text_cache_size_mb = DEFAULT_FORECAST_TEXT_CACHE_SIZE_MB;
+    lconf.lookupValue("forecast_text_cache_size_mb", forecast_text_cache_size_mb);
+    itsForecastTextCacheBytes = std::size_t(forecast_text_cache_size_mb) * 1024 * 1024;
+
+    // The former limit in number of texts is converted using an average text size
+    unsigned int forecast_text_cache_size = 0;
+    if (lconf.lookupValue("forecast_text_cache_size", forecast_text_cache_size))
+    {
+      if (lconf.exists("forecast_text_cache_size_mb"))
+      {
+        std::cout << ANSI_FG_RED
+                  << "Textgen: forecast_text_cache_size is obsolete and ignored, "
+                     "forecast_text_cache_size_mb is used instead"
+                  << ANSI_FG_DEFAULT << '\n';
+      }
+      else
+      {
+        itsForecastTextCacheBytes =
+            std::size_t(forecast_text_cache_size) * LEGACY_FORECAST_TEXT_SIZE;
+        std::cout << ANSI_FG_RED << "Textgen: forecast_text_cache_size is obsolete, "
+                  << forecast_text_cache_size << " texts are taken to mean "
+                  << itsForecastTextCacheBytes / 1024 << " KB. Use forecast_text_cache_size_mb"
+                  << ANSI_FG_DEFAULT << '\n';
+      }
+    }
+    lconf.lookupValue("document_cache_size", itsDocumentCacheSize);
+    lconf.lookupValue("wkt_cache_size", itsWktCacheSize);
+    lconf.lookupValue("location_cache_size", itsLocationCacheSize);
+    lconf.lookupValue("stale_while_revalidate", itsStaleWhileRevalidate);
+    lconf.lookupValue("refresh_threads", itsRefreshThreads);
+    lconf.lookupValue("refresh_queue_size", itsRefreshQueueSize);
+    lconf.lookupValue("forecasttime_resolution", itsForecastTimeResolution);
+    if (itsForecastTimeResolution <= 0)
+      itsForecastTimeResolution = 1;
+    lconf.lookupValue("max_parallel_areas", itsMaxParallelAreas);
+    if (itsMaxParallelAreas == 0)
+      itsMaxParallelAreas = 1;
+    lconf.lookupValue("area_threads", itsAreaThreads);
+    lconf.lookupValue("max_parallel_jobs", itsMaxParallelJobs);
+    if (itsMaxParallelJobs == 0)
+      itsMaxParallelJobs = 1;
+    lconf.lookupValue("max_batch_jobs", itsMaxBatchJobs);
+    lconf.lookupValue("disk_cache.directory", itsDiskCacheDirectory);
+    unsigned int disk_cache_size_mb = DEFAULT_DISK_CACHE_SIZE_MB;
+    lconf.lookupValue("disk_cache.max_size_mb", disk_cache_size_mb);
+    itsDiskCacheSize = std::size_t(disk_cache_size_mb) * 1024 * 1024;
+    lconf.lookupValue("precompress", itsPrecompress);
+    lconf.lookupValue("freshness.min_age", itsMinFreshness);
+    lconf.lookupValue("freshness.max_age", itsMaxFreshness);
+    lconf.lookupValue("freshness.update_interval", itsUpdateInterval);
+    if (itsMaxFreshness < itsMinFreshness)
+      itsMaxFreshness = itsMinFreshness;
     lconf.lookupValue("url", itsDefaultUrl);
     lconf.lookupValue("dictionary", itsDictionary);
     lconf.lookupValue("filedictionaries", itsFileDictionaries);
@@ -444,9 +537,8 @@ void Config::init(SmartMet::Engine::Gis::Engine* pGisEngine)
     // Set monitoring directories
     ConfigItemVector configItems = readMainConfig();
     std::set<std::string> emptyset;
-    itsProductConfigs = updateProductConfigs(configItems, emptyset, emptyset, emptyset);
-    itsGeometryStorage = loadGeometries(itsProductConfigs);
-    itsProductMasks = readMasks(itsGeometryStorage, itsProductConfigs);
+    ConfigSnapshotPtr snapshot = buildSnapshot(configItems, emptyset, emptyset, emptyset, nullptr);
+    std::atomic_store(&itsSnapshot, snapshot);
 
     db_connect_info dci;
 
@@ -488,6 +580,8 @@ void Config::init(SmartMet::Engine::Gis::Engine* pGisEngine)
           "Textgenplugin configuration error! No database connection info found for " +
               itsDictionary);
 
+    monitorQuerydata(*snapshot->itsProductConfigs);
+
     boost::regex pattern(R"(^[\w,\s-]+\.[A-Za-z]+$)");
 
     for (const auto& dir : getDirectoriesToMonitor(configItems))
@@ -516,6 +610,226 @@ void Config::init(SmartMet::Engine::Gis::Engine* pGisEngine)
   }
 }
 
+// ----------------------------------------------------------------------
+/*!
+ * \brief Start monitoring the querydata referenced by the products
+ *
+ * Querydata added by later configuration updates is not monitored, texts
+ * of such products expire by time as before.
+ */
+// ----------------------------------------------------------------------
+
+void Config::monitorQuerydata(const ProductConfigMap& productConfigs)
+{
+  using namespace boost::placeholders;
+
+  try
+  {
+    std::set<std::string> paths;
+    for (const auto& pci : productConfigs)
+      for (const auto& item : pci.second->getForecastDataConfigs())
+        paths.insert(item.second);
+
+    for (const auto& querydata : paths)
+    {
+      std::filesystem::path path(querydata);
+      std::filesystem::path dir = (std::filesystem::is_directory(path) ? path : path.parent_path());
+      if (dir.empty())
+        dir = ".";
+      if (!std::filesystem::is_directory(dir))
+      {
+        std::cout << ANSI_FG_RED << "Querydata '" << querydata
+                  << "' not found, its changes are not monitored" << ANSI_FG_DEFAULT << '\n';
+        continue;
+      }
+
+      {
+        std::lock_guard<std::mutex> lock(itsDataVersionMutex);
+        itsDataVersions[querydata] = data_version();
+      }
+
+      itsMonitor.watch(
+          dir,
+          boost::regex(".*"),
+          [this, querydata](Fmi::DirectoryMonitor::Watcher /* id */,
+                            const std::filesystem::path& /* dir */,
+                            const boost::regex& /* pattern */,
+                            const Fmi::DirectoryMonitor::Status& status)
+          { updateDataVersion(querydata, status); },
+          boost::bind(error, _1, _2, _3, _4),
+          5,
+          Fmi::DirectoryMonitor::CREATE | Fmi::DirectoryMonitor::DELETE |
+              Fmi::DirectoryMonitor::MODIFY | Fmi::DirectoryMonitor::ERROR);
+    }
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Directory monitor callback for querydata changes
+ *
+ * The version is identified by the names, modification times and sizes of
+ * all the files of the querydata, so that replacing any file is noticed
+ * even if the newest modification time stays the same. A new version also
+ * records the time the change was noticed.
+ */
+// ----------------------------------------------------------------------
+
+void Config::updateDataVersion(const std::string& querydata,
+                               const Fmi::DirectoryMonitor::Status& status)
+{
+  try
+  {
+    if (status->empty())
+      return;
+
+    // The version is derived from the data only, never from the current time,
+    // so that it stays the same over restarts and persisted texts remain valid
+    const std::filesystem::path path(querydata);
+    std::vector<std::filesystem::path> files;
+    if (!std::filesystem::is_directory(path))
+    {
+      if (std::filesystem::exists(path))
+        files.push_back(path);
+    }
+    else
+    {
+      for (const auto& entry : std::filesystem::directory_iterator(path))
+        if (entry.is_regular_file())
+          files.push_back(entry.path());
+      std::sort(files.begin(), files.end());
+    }
+
+    std::time_t newest = 0;
+    std::uint64_t id = 0;
+    for (const auto& file : files)
+    {
+      const std::time_t modified = NFmiFileSystem::FileModificationTime(file.string());
+      newest = std::max(newest, modified);
+      id = stable_hash_combine(id, stable_hash(file.filename().string()));
+      id = stable_hash_combine(id, static_cast<std::uint64_t>(modified));
+      std::error_code ec;
+      id = stable_hash_combine(id, std::filesystem::file_size(file, ec));
+    }
+
+    // Without any data there is nothing to version
+    if (newest == 0)
+      return;
+
+    std::lock_guard<std::mutex> lock(itsDataVersionMutex);
+    auto& version = itsDataVersions[querydata];
+
+    if (version.id == 0)
+    {
+      version.id = id;
+      version.current = newest;
+    }
+    else if (id != version.id)
+    {
+      const std::time_t now = std::time(nullptr);
+      if (version.changed > 0)
+        version.interval = now - version.changed;
+      version.previous_id = version.id;
+      version.previous = version.current;
+      version.changed = now;
+      version.id = id;
+      version.current = newest;
+    }
+  }
+  catch (...)
+  {
+    Fmi::Exception::Trace(BCP, "Querydata monitoring failed").printError();
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Versions of the querydata of the product
+ *
+ * The id of the product combines the ids of all its querydata, so that an
+ * update of any of them changes it. The current time is the newest of the
+ * querydata. The previous version is the one the product had before its
+ * most recent querydata change.
+ * The next update is the earliest expected update of any of the querydata,
+ * unknown if the update interval of some querydata is unknown.
+ */
+// ----------------------------------------------------------------------
+
+data_version Config::getDataVersion(const ProductConfig& config) const
+{
+  std::lock_guard<std::mutex> lock(itsDataVersionMutex);
+
+  data_version ret;
+  const data_version* latest = nullptr;
+  bool next_update_known = true;
+  for (const auto& item : config.getForecastDataConfigs())
+  {
+    auto pos = itsDataVersions.find(item.second);
+    if (pos == itsDataVersions.end() || pos->second.id == 0)
+      return {};
+    const data_version& version = pos->second;
+    ret.id = stable_hash_combine(ret.id, version.id);
+    ret.current = std::max(ret.current, version.current);
+    if (!latest || version.changed > latest->changed)
+      latest = &version;
+
+    // The observed interval overrides the configured one
+    const std::time_t interval = (version.interval > 0 ? version.interval : itsUpdateInterval);
+    if (interval <= 0)
+      next_update_known = false;
+    else
+    {
+      const std::time_t last_update = (version.changed > 0 ? version.changed : version.current);
+      const std::time_t next_update = last_update + interval;
+      if (ret.next_update == 0 || next_update < ret.next_update)
+        ret.next_update = next_update;
+    }
+  }
+
+  if (!next_update_known)
+    ret.next_update = 0;
+
+  if (!latest || latest->changed == 0)
+    return ret;
+
+  ret.changed = latest->changed;
+  ret.previous = latest->previous;
+  for (const auto& item : config.getForecastDataConfigs())
+  {
+    const auto& version = itsDataVersions.at(item.second);
+    ret.previous_id =
+        stable_hash_combine(ret.previous_id, &version == latest ? version.previous_id : version.id);
+    if (&version != latest)
+      ret.previous = std::max(ret.previous, version.current);
+  }
+
+  return ret;
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Seconds responses of the given querydata version stay fresh
+ *
+ * Texts cannot change before the querydata is updated, so responses are
+ * fresh until the expected next update, within the configured limits.
+ * Texts of unmonitored querydata or of querydata whose next update is
+ * not known, or is already overdue, get the minimum freshness.
+ */
+// ----------------------------------------------------------------------
+
+int Config::getFreshness(const data_version& version, std::time_t now) const
+{
+  if (version.current == 0 || version.next_update <= now)
+    return itsMinFreshness;
+
+  const std::time_t remaining = version.next_update - now;
+  return static_cast<int>(std::clamp<std::time_t>(remaining, itsMinFreshness, itsMaxFreshness));
+}
+
 std::set<std::string> Config::getDirectoriesToMonitor(const ConfigItemVector& configItems) const
 {
   std::set<std::string> ret;
@@ -580,10 +894,24 @@ std::unique_ptr<ProductConfigMap> Config::updateProductConfigs(
     const ConfigItemVector& configItems,
     const std::set<std::string>& deletedFiles,
     const std::set<std::string>& modifiedFiles,
-    const std::set<std::string>& newFiles)
+    const std::set<std::string>& newFiles,
+    const ProductConfigMap* previousConfigs)
 {
   std::string config_value;
   std::set<std::string> erroneousFiles;
+  const std::set<std::string> files = changedFiles(deletedFiles, modifiedFiles, newFiles);
+
+  // Previous configuration of the product if its file has not changed since
+  auto unchanged = [&](const std::string& name,
+                       const std::string& file) -> std::shared_ptr<ProductConfig>
+  {
+    if (previousConfigs == nullptr || files.find(file) != files.end())
+      return nullptr;
+    auto pos = previousConfigs->find(name);
+    if (pos == previousConfigs->end() || pos->second->itsConfigFile != file)
+      return nullptr;
+    return pos->second;
+  };
 
   Fmi::AsyncTask::interruption_point();
 
@@ -606,18 +934,34 @@ std::unique_ptr<ProductConfigMap> Config::updateProductConfigs(
 
     auto newProductConfigs = std::unique_ptr<ProductConfigMap>(new ProductConfigMap());
     std::shared_ptr<ProductConfig> pDefultConfig;
+    // Products inherit settings from the default configuration, hence all of them
+    // must be parsed again if it changes
+    bool defaultChanged = (previousConfigs == nullptr);
     if (products.find(default_textgen_config_name) != products.end())
     {
-      std::shared_ptr<ProductConfig> productConfig(new ProductConfig(
-          products.at(default_textgen_config_name), pDefultConfig, itsDictionary));
-      newProductConfigs->insert(std::make_pair(default_textgen_config_name, productConfig));
-      if (modifiedFiles.find(default_textgen_config_name) != modifiedFiles.end())
+      const std::string& default_file = products.at(default_textgen_config_name);
+      std::shared_ptr<ProductConfig> productConfig =
+          unchanged(default_textgen_config_name, default_file);
+      if (!productConfig)
       {
-        TextGenPosixTime timestamp;
-        productConfig->itsLastModifiedTime = timestamp.EpochTime();
+        defaultChanged = true;
+        productConfig.reset(new ProductConfig(default_file, pDefultConfig, itsDictionary));
+        if (modifiedFiles.find(default_file) != modifiedFiles.end())
+        {
+          TextGenPosixTime timestamp;
+          productConfig->itsLastModifiedTime = timestamp.EpochTime();
+        }
+        // A reused configuration may be in use by requests, only new ones are compiled
+        productConfig->compileSettings();
       }
+      newProductConfigs->insert(std::make_pair(default_textgen_config_name, productConfig));
       pDefultConfig = newProductConfigs->at(default_textgen_config_name);
     }
+    else if (previousConfigs != nullptr &&
+             previousConfigs->find(default_textgen_config_name) != previousConfigs->end())
+    {
+      defaultChanged = true;
+    }
 
     std::string config_file;
     for (const auto& product : products)
@@ -631,9 +975,20 @@ std::unique_ptr<ProductConfigMap> Config::updateProductConfigs(
 
         Fmi::AsyncTask::interruption_point();
 
+        if (!defaultChanged)
+        {
+          std::shared_ptr<ProductConfig> productConfig = unchanged(config_name, config_file);
+          if (productConfig)
+          {
+            newProductConfigs->insert(std::make_pair(config_name, productConfig));
+            continue;
+          }
+        }
+
         std::shared_ptr<ProductConfig> productConfig(
             new ProductConfig(config_file, pDefultConfig, itsDictionary));
         productConfig->setDefaultConfig(pDefultConfig);
+        productConfig->compileSettings();
         newProductConfigs->insert(std::make_pair(config_name, productConfig));
         if (modifiedFiles.find(config_file) != modifiedFiles.end())
         {
@@ -721,23 +1076,148 @@ void Config::update(Fmi::DirectoryMonitor::Watcher /*id*/,
     std::string details = e.getDetailByIndex(0);
     std::cout << ANSI_FG_RED << details << " Textgen plugin is now inactive!" << ANSI_FG_DEFAULT
               << '\n';
-    itsProductConfigs->clear();
+    auto snapshot = std::make_shared<ConfigSnapshot>();
+    snapshot->itsProductConfigs = std::make_unique<ProductConfigMap>();
+    snapshot->itsGeometries =
+        std::make_shared<GeometryCache>(std::make_unique<Engine::Gis::GeometryStorage>());
+    snapshot->itsProductMasks = std::make_unique<ProductWeatherAreaMap>();
+    std::atomic_store(&itsSnapshot, ConfigSnapshotPtr(snapshot));
     return;
   }
 
-  std::unique_ptr<ProductConfigMap> prodConf =
-      updateProductConfigs(configItems, deletedFiles, modifiedFiles, newFiles);
-  std::unique_ptr<Engine::Gis::GeometryStorage> geomStorage = loadGeometries(prodConf);
-  std::unique_ptr<ProductWeatherAreaMap> productMasks = readMasks(geomStorage, prodConf);
+  // Requests in progress keep using the previous snapshot, which is
+  // released when the last of them finishes
+  const ConfigSnapshotPtr previous = snapshot();
+  std::atomic_store(
+      &itsSnapshot,
+      buildSnapshot(configItems, deletedFiles, modifiedFiles, newFiles, previous.get()));
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Build a new snapshot, reusing unchanged parts of the previous one
+ *
+ * A product is parsed again only if its own file or default.conf changed.
+ * Geometries are reloaded if any product was parsed again or removed, and
+ * masks only for parsed products or if their mask files changed.
+ */
+// ----------------------------------------------------------------------
+
+ConfigSnapshotPtr Config::buildSnapshot(const ConfigItemVector& configItems,
+                                        const std::set<std::string>& deletedFiles,
+                                        const std::set<std::string>& modifiedFiles,
+                                        const std::set<std::string>& newFiles,
+                                        const ConfigSnapshot* previous)
+{
+  try
+  {
+    auto snapshot = std::make_shared<ConfigSnapshot>();
+    snapshot->itsProductConfigs =
+        updateProductConfigs(configItems,
+                             deletedFiles,
+                             modifiedFiles,
+                             newFiles,
+                             previous ? previous->itsProductConfigs.get() : nullptr);
+
+    for (const auto& pci : *snapshot->itsProductConfigs)
+      for (const auto& id : pci.second->postgis_identifiers)
+        snapshot->itsPostGISIdentifierKeys.insert(id.first);
+
+    // The contents of PostGIS sources may change even if their identifiers do
+    // not, so editing any product configuration reloads the geometries. A new
+    // geometry generation also discards the resolved locations of requests.
+    const bool reuseGeometries =
+        (previous != nullptr && previous->itsGeometries &&
+         previous->itsPostGISIdentifierKeys == snapshot->itsPostGISIdentifierKeys &&
+         sameProducts(*snapshot->itsProductConfigs, *previous->itsProductConfigs));
+
+    if (reuseGeometries)
+      snapshot->itsGeometries = previous->itsGeometries;
+    else
+      snapshot->itsGeometries =
+          std::make_shared<GeometryCache>(loadGeometries(snapshot->itsProductConfigs));
+
+    const std::set<std::string> files = changedFiles(deletedFiles, modifiedFiles, newFiles);
+
+    snapshot->itsProductMasks.reset(new ProductWeatherAreaMap());
+    for (const auto& pci : *snapshot->itsProductConfigs)
+    {
+      const std::string& product_name = pci.first;
+      const ProductConfig& config = *pci.second;
+
+      bool reuseMasks = reuseGeometries && !masksChanged(config, files);
+      if (reuseMasks)
+      {
+        auto oldConfig = previous->itsProductConfigs->find(product_name);
+        auto oldMasks = previous->itsProductMasks->find(product_name);
+        reuseMasks = (oldConfig != previous->itsProductConfigs->end() &&
+                      oldConfig->second == pci.second &&
+                      oldMasks != previous->itsProductMasks->end());
+        if (reuseMasks)
+          snapshot->itsProductMasks->insert(*oldMasks);
+      }
+
+      if (!reuseMasks)
+        snapshot->itsProductMasks->insert(
+            std::make_pair(product_name, readMasks(*snapshot->itsGeometries, config)));
 
-  SmartMet::Spine::WriteLock lock(itsConfigUpdateMutex);
+      // Cheap to rebuild, the areas themselves are cached in itsGeometries
+      auto pointAreas = makePointAreaIndex(*snapshot->itsGeometries, config);
+      if (pointAreas)
+        snapshot->itsPointAreaIndexes.insert(std::make_pair(product_name, pointAreas));
+    }
+
+    Fmi::AsyncTask::interruption_point();
 
-  itsProductConfigs = std::move(prodConf);
-  itsGeometryStorage = std::move(geomStorage);
-  itsProductMasks = std::move(productMasks);
+    return snapshot;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
 }
 
-const ProductConfig& Config::getProductConfig(const std::string& config_name) const
+GeometryCache::GeometryCache(std::unique_ptr<Engine::Gis::GeometryStorage> storage)
+    : itsStorage(std::move(storage)), itsGeneration(++geometry_generations)
+{
+}
+
+TextGen::WeatherArea GeometryCache::makeArea(const std::string& shapeKey,
+                                             const std::string& areaName) const
+{
+  try
+  {
+    const auto key = std::make_pair(shapeKey, areaName);
+    {
+      std::lock_guard<std::mutex> lock(itsMutex);
+      auto pos = itsAreas.find(key);
+      if (pos != itsAreas.end())
+        return pos->second;
+    }
+
+    // Parse outside the lock, a concurrent duplicate is merely discarded
+    if (itsStorage->isPolygon(shapeKey))
+    {
+      std::stringstream svg_string_stream(itsStorage->getSVGPath(shapeKey));
+      NFmiSvgPath svgPath;
+      svgPath.Read(svg_string_stream);
+      TextGen::WeatherArea area(svgPath, areaName);
+      std::lock_guard<std::mutex> lock(itsMutex);
+      return itsAreas.insert(std::make_pair(key, area)).first->second;
+    }
+
+    // if not polygon, it must be a point
+    std::pair<float, float> std_point(itsStorage->getPoint(shapeKey));
+    NFmiPoint point(std_point.first, std_point.second);
+    return {point, areaName};
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+const ProductConfig& ConfigSnapshot::getProductConfig(const std::string& config_name) const
 {
   try
   {
@@ -771,25 +1251,34 @@ std::unique_ptr<Engine::Gis::GeometryStorage> Config::loadGeometries(
   return newGeometryStorage;
 }
 
-bool Config::geoObjectExists(const std::string& postGISName, const std::string& areasource) const
+bool ConfigSnapshot::geoObjectExists(const std::string& postGISName,
+                                     const std::string& areasource) const
 {
   std::string shapeKey = (postGISName + areasource);
   Engine::Gis::normalize_string(shapeKey);
-  return itsGeometryStorage->geoObjectExists(shapeKey);
+  return itsGeometries->storage().geoObjectExists(shapeKey);
 }
 
-const WeatherAreas& Config::getProductMasks(const std::string& product_name) const
+const WeatherAreas& ConfigSnapshot::getProductMasks(const std::string& product_name) const
 {
   return itsProductMasks->at(product_name);
 }
 
-bool Config::productConfigExists(const std::string& config_name) const
+const AreaIndex* ConfigSnapshot::getPointAreaIndex(const std::string& product_name) const
+{
+  auto pos = itsPointAreaIndexes.find(product_name);
+  if (pos == itsPointAreaIndexes.end())
+    return nullptr;
+  return pos->second.get();
+}
+
+bool ConfigSnapshot::productConfigExists(const std::string& config_name) const
 {
   return itsProductConfigs->find(config_name) != itsProductConfigs->end();
 }
 
-TextGen::WeatherArea Config::makePostGisArea(const std::string& postGISName,
-                                             const std::string& areasource) const
+TextGen::WeatherArea ConfigSnapshot::makePostGisArea(const std::string& postGISName,
+                                                     const std::string& areasource) const
 {
   try
   {
@@ -798,18 +1287,7 @@ TextGen::WeatherArea Config::makePostGisArea(const std::string& postGISName,
     Engine::Gis::normalize_string(areaName);
     Engine::Gis::normalize_string(shapeKey);
 
-    if (itsGeometryStorage->isPolygon(shapeKey))
-    {
-      std::stringstream svg_string_stream(itsGeometryStorage->getSVGPath(shapeKey));
-      NFmiSvgPath svgPath;
-      svgPath.Read(svg_string_stream);
-      return {svgPath, areaName};
-    }
-
-    // if not polygon, it must be a point
-    std::pair<float, float> std_point(itsGeometryStorage->getPoint(shapeKey));
-    NFmiPoint point(std_point.first, std_point.second);
-    return {point, areaName};
+    return itsGeometries->makeArea(shapeKey, areaName);
   }
   catch (...)
   {
@@ -826,6 +1304,7 @@ TextGen::WeatherArea Config::makePostGisArea(const std::string& postGISName,
 ProductConfig::ProductConfig(const std::string& configfile,
                              const std::shared_ptr<ProductConfig>& pDefaultConf,
                              const std::string& /*dictionary*/)
+    : itsConfigFile(configfile)
 {
   std::string exceptionDetails;
   try
@@ -863,6 +1342,22 @@ ProductConfig::ProductConfig(const std::string& configfile,
     itsConfig.lookupValue("misc.timeformat", itsTimeFormat);
     itsConfig.lookupValue("misc.language", itsLanguage);
     itsConfig.lookupValue("misc.formatter", itsFormatter);
+    itsConfig.lookupValue("misc.coordinate_grid", itsCoordinateGrid);
+    if (itsConfig.exists("misc.point_areas"))
+    {
+      libconfig::Setting& setting = itsConfig.lookup("misc.point_areas");
+      if (setting.isArray())
+      {
+        for (int i = 0; i < setting.getLength(); i++)
+        {
+          std::string value = setting[i];
+          itsPointAreas.push_back(value);
+        }
+      }
+    }
+    std::string point_areasource;
+    if (itsConfig.lookupValue("misc.point_areasource", point_areasource))
+      itsPointAreaSource = point_areasource;
     itsConfig.lookupValue("forestfirewarning.directory", itsForestFireWarningDirectory);
 
     // PostGIS
@@ -1207,6 +1702,15 @@ void ProductConfig::setDefaultConfig(const std::shared_ptr<ProductConfig>& pDefa
       if (itsTimeFormat.empty())
         itsTimeFormat = pDefaultConfig->itsTimeFormat;
 
+      if (itsCoordinateGrid < 0)
+        itsCoordinateGrid = pDefaultConfig->itsCoordinateGrid;
+
+      if (itsPointAreas.empty())
+        itsPointAreas = pDefaultConfig->itsPointAreas;
+
+      if (!itsPointAreaSource)
+        itsPointAreaSource = pDefaultConfig->itsPointAreaSource;
+
       // Use hard-coded default values
       if (itsLanguage.empty())
         itsLanguage = default_language;
@@ -1374,6 +1878,71 @@ const std::pair<std::string, std::string>& ProductConfig::getFireWarningAreaCode
   }
 }
 
+// ----------------------------------------------------------------------
+/*!
+ * \brief Compile the calculator settings of the product
+ *
+ * Requests install the compiled settings as is instead of building the
+ * setting names from the configuration items again. When a setting is
+ * given more than once, the last one wins as it would in Settings.
+ */
+// ----------------------------------------------------------------------
+
+void ProductConfig::compileSettings()
+{
+  try
+  {
+    static std::atomic<std::size_t> generations{0};
+
+    // An empty key means the setting cannot be overridden
+    std::vector<overridable_setting> items;
+    auto add = [&items](const std::string& key, const std::string& name, const std::string& value)
+    { items.push_back(overridable_setting{key, name, value}); };
+
+    // frostseason-parameter is used by old stories
+    add("", "textgen::frostseason", (itsFrostSeason ? "true" : "false"));
+
+    for (const auto& item : itsParameterMappings)
+      add("", item.first, item.second);
+
+    for (const auto& item : forecast_data_config_items)
+      add("", "textgen::" + item.first, item.second);
+
+    for (const auto& item : unit_format_config_items)
+      add(item.first, "textgen::units::" + item.first + "::format", item.second);
+
+    for (const auto& item : output_document_config_items)
+      add(item.first, item.first, item.second);
+
+    for (const auto& item : area_config_items)
+      add("", item.first, item.second);
+
+    add("", "qdtext::forestfirewarning::directory", itsForestFireWarningDirectory);
+    for (const auto& item : forestfirewarning_areacodes)
+      add("", item.first, item.second);
+
+    product_settings settings;
+    settings.generation = ++generations;
+
+    std::set<std::string> names;
+    for (auto item = items.rbegin(); item != items.rend(); ++item)
+    {
+      if (!names.insert(item->name).second)
+        continue;
+      if (item->key.empty())
+        settings.fixed.emplace_back(item->name, item->value);
+      else
+        settings.overridable.push_back(*item);
+    }
+
+    itsSettings = std::move(settings);
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
 // Checks if configuration has been modified within given interval (seconds)
 bool ProductConfig::isModified(size_t interval) const
 {
@@ -7,6 +7,7 @@
 #ifndef TEXTGEN_CONFIG_H
 #define TEXTGEN_CONFIG_H
 
+#include "AreaIndex.h"
 #include <calculator/WeatherArea.h>
 #include <engines/gis/Engine.h>
 #include <engines/gis/GeometryStorage.h>
@@ -14,8 +15,15 @@
 #include <macgyver/DirectoryMonitor.h>
 #include <spine/Thread.h>
 #include <libconfig.h++>
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <ctime>
 #include <map>
 #include <memory>
+#include <mutex>
+#include <optional>
+#include <set>
 #include <string>
 #include <vector>
 
@@ -47,6 +55,34 @@ struct db_connect_info
 
 using DatabaseConnectInfo = std::map<std::string, db_connect_info>;
 
+// Versions of monitored querydata, all zero when the querydata is not monitored
+struct data_version
+{
+  std::uint64_t id = 0;           // hash of the names, times and sizes of all the files
+  std::uint64_t previous_id = 0;  // id before the latest change
+  std::time_t current = 0;        // newest modification
+  std::time_t previous = 0;       // newest modification before the latest change
+  std::time_t changed = 0;      // when the latest change was noticed
+  std::time_t interval = 0;     // observed time between the two latest changes
+  std::time_t next_update = 0;  // expected next change, 0 if unknown
+};
+
+// A product setting which request parameters may override
+struct overridable_setting
+{
+  std::string key;    // request parameters matching the end of the key override the value
+  std::string name;   // name of the setting
+  std::string value;  // configured value
+};
+
+// Settings of a product, compiled once when the product is loaded
+struct product_settings
+{
+  std::size_t generation = 0;  // unique for each compiled instance
+  ConfigItemVector fixed;
+  std::vector<overridable_setting> overridable;
+};
+
 class ProductConfig
 {
  public:
@@ -61,6 +97,7 @@ class ProductConfig
   const std::string& timeFormat() const { return itsTimeFormat; }
   const std::string& forestfirewarning_directory() const { return itsForestFireWarningDirectory; }
   const libconfig::Config& config() const { return itsConfig; }
+  const std::string& configFile() const { return itsConfigFile; }
   const std::string& getAreaTimeZone(const std::string& area) const;
 
   const Engine::Gis::postgis_identifier& getDefaultPostGISIdentifier() const;
@@ -101,10 +138,22 @@ class ProductConfig
     return forestfirewarning_areacodes;
   }
   bool isFrostSeason() const { return itsFrostSeason; }
+  // Grid in degrees point coordinates are snapped to, 0 if they are used as is
+  double coordinateGrid() const { return std::max(0.0, itsCoordinateGrid); }
+  // PostGIS areas which points inside them resolve to, in order of preference
+  const std::vector<std::string>& getPointAreas() const { return itsPointAreas; }
+  // Areasource of the point areas, requests with other areasources do not use them
+  const std::string& getPointAreaSource() const
+  {
+    static const std::string none;
+    return itsPointAreaSource ? *itsPointAreaSource : none;
+  }
   bool isModified(size_t interval) const;
+  const product_settings& settings() const { return itsSettings; }
 
  private:
   libconfig::Config itsConfig;
+  std::string itsConfigFile;
   std::map<std::string, std::string> area_timezones;
   std::map<std::string, Engine::Gis::postgis_identifier> postgis_identifiers;
   std::string itsDefaultPostGISIdentifierKey;
@@ -123,9 +172,14 @@ class ProductConfig
   std::string itsForestFireWarningDirectory;
   ParameterMappings itsParameterMappings;
   bool itsFrostSeason = false;
+  double itsCoordinateGrid = -1;  // negative if not set
+  std::vector<std::string> itsPointAreas;
+  std::optional<std::string> itsPointAreaSource;  // empty if not set
   size_t itsLastModifiedTime = 0;  // epoch seconds
+  product_settings itsSettings;
 
   std::shared_ptr<ProductConfig> pDefaultConfig;
+  void compileSettings();
   const std::map<std::string, Engine::Gis::postgis_identifier>& getPostGISIdentifiersPrivate()
   {
     return postgis_identifiers;
@@ -134,22 +188,103 @@ class ProductConfig
   friend class Config;
 };
 
-class Config : private boost::noncopyable
+// ----------------------------------------------------------------------
+/*!
+ * \brief Loaded geometries and the areas built from them
+ *
+ * Parsing the SVG path of a polygon is expensive, hence each area is built
+ * only once and later requests get a copy sharing the parsed path.
+ */
+// ----------------------------------------------------------------------
+
+class GeometryCache : private boost::noncopyable
 {
  public:
-  Config(std::string configfile);
-  virtual ~Config();
-  void init(SmartMet::Engine::Gis::Engine* pGisEngine);
-  void shutdown();
+  explicit GeometryCache(std::unique_ptr<Engine::Gis::GeometryStorage> storage);
+
+  const Engine::Gis::GeometryStorage& storage() const { return *itsStorage; }
+  // Unique for each loaded set of geometries
+  std::size_t generation() const { return itsGeneration; }
+  TextGen::WeatherArea makeArea(const std::string& shapeKey, const std::string& areaName) const;
+
+ private:
+  std::unique_ptr<const Engine::Gis::GeometryStorage> itsStorage;
+  const std::size_t itsGeneration;
+  mutable std::mutex itsMutex;
+  // shape key + area name -> area
+  mutable std::map<std::pair<std::string, std::string>, TextGen::WeatherArea> itsAreas;
+};
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Immutable product configurations, geometries and masks
+ *
+ * Config publishes a new snapshot after each update, requests keep the
+ * snapshot they started with until they finish.
+ */
+// ----------------------------------------------------------------------
 
-  int getForecastTextCacheSize() const { return itsForecastTextCacheSize; }
+class ConfigSnapshot : private boost::noncopyable
+{
+ public:
   const ProductConfig& getProductConfig(const std::string& config_name) const;
+  bool productConfigExists(const std::string& config_name) const;
   bool geoObjectExists(const std::string& postGISName, const std::string& areasource) const;
   TextGen::WeatherArea makePostGisArea(const std::string& postGISName,
                                        const std::string& areasource) const;
   const WeatherAreas& getProductMasks(const std::string& product_name) const;
+  // Index of the point areas of the product, nullptr if it has none
+  const AreaIndex* getPointAreaIndex(const std::string& product_name) const;
+  const ProductConfigMap& getProductConfigs() const { return *itsProductConfigs; }
+  std::size_t geometryGeneration() const { return itsGeometries->generation(); }
 
-  bool productConfigExists(const std::string& config_name) const;
+ private:
+  std::unique_ptr<ProductConfigMap> itsProductConfigs;
+  // Geometries and their svg-representations are stored here, shared with the
+  // previous snapshot if the PostGIS sources did not change
+  std::shared_ptr<const GeometryCache> itsGeometries;
+  // Keys of all PostGIS sources in itsGeometries
+  std::set<std::string> itsPostGISIdentifierKeys;
+  // Here we store masks by product
+  std::unique_ptr<ProductWeatherAreaMap> itsProductMasks;
+  // Point areas by product
+  std::map<std::string, std::shared_ptr<const AreaIndex>> itsPointAreaIndexes;
+
+  friend class Config;
+};
+
+using ConfigSnapshotPtr = std::shared_ptr<const ConfigSnapshot>;
+
+class Config : private boost::noncopyable
+{
+ public:
+  Config(std::string configfile);
+  virtual ~Config();
+  void init(SmartMet::Engine::Gis::Engine* pGisEngine);
+  void shutdown();
+
+  std::size_t getForecastTextCacheBytes() const { return itsForecastTextCacheBytes; }
+  int getDocumentCacheSize() const { return itsDocumentCacheSize; }
+  int getWktCacheSize() const { return itsWktCacheSize; }
+  int getLocationCacheSize() const { return itsLocationCacheSize; }
+  unsigned int getMaxParallelAreas() const { return itsMaxParallelAreas; }
+  unsigned int getAreaThreads() const { return itsAreaThreads; }
+  unsigned int getMaxParallelJobs() const { return itsMaxParallelJobs; }
+  std::size_t getMaxBatchJobs() const { return itsMaxBatchJobs; }
+  // The current configuration, never blocks
+  ConfigSnapshotPtr snapshot() const { return std::atomic_load(&itsSnapshot); }
+
+  data_version getDataVersion(const ProductConfig& config) const;
+  int getStaleWhileRevalidate() const { return itsStaleWhileRevalidate; }
+  unsigned int getRefreshThreads() const { return itsRefreshThreads; }
+  unsigned int getRefreshQueueSize() const { return itsRefreshQueueSize; }
+  int getForecastTimeResolution() const { return itsForecastTimeResolution; }
+  const std::string& getDiskCacheDirectory() const { return itsDiskCacheDirectory; }
+  std::size_t getDiskCacheSize() const { return itsDiskCacheSize; }
+  bool getPrecompress() const { return itsPrecompress; }
+  // Max-age of responses of the given querydata version
+  int getFreshness(const data_version& version, std::time_t now) const;
+  int getMinFreshness() const { return itsMinFreshness; }
 
   const std::string& defaultUrl() const { return itsDefaultUrl; }
   const std::set<std::string>& supportedLanguages() const { return itsSupportedLanguages; }
@@ -166,18 +301,39 @@ class Config : private boost::noncopyable
   //  itsDatabaseConnectInfo.end()); }
   const std::string& fileDictionaries() const { return itsFileDictionaries; }
 
-  // Mutex for updating Configuration
-  SmartMet::Spine::MutexType itsConfigUpdateMutex;
-
  private:
-  std::unique_ptr<ProductConfigMap> itsProductConfigs;
-  // Geometries and their svg-representations are stored here
-  std::unique_ptr<Engine::Gis::GeometryStorage> itsGeometryStorage;
-  // Here we store masks by product
-  std::unique_ptr<ProductWeatherAreaMap> itsProductMasks;
+  // Accessed only with std::atomic_load and std::atomic_store
+  ConfigSnapshotPtr itsSnapshot;
 
   std::string itsDefaultUrl;
-  int itsForecastTextCacheSize = 0;
+  std::size_t itsForecastTextCacheBytes = 0;
+  int itsDocumentCacheSize = 0;
+  int itsWktCacheSize = 0;
+  int itsLocationCacheSize = 0;
+  // Upper limit for the number of areas of a single request generated in parallel
+  unsigned int itsMaxParallelAreas = 1;
+  // Threads shared by all requests for generating areas in parallel
+  unsigned int itsAreaThreads = 0;
+  // Upper limits for the number of jobs of a batch request run in parallel and in total
+  unsigned int itsMaxParallelJobs = 1;
+  unsigned int itsMaxBatchJobs = 0;
+  // How long texts of the previous querydata may be served while regenerating, 0 disables
+  int itsStaleWhileRevalidate = 0;
+  // Threads regenerating stale texts, and the number of regenerations waiting for them
+  unsigned int itsRefreshThreads = 0;
+  unsigned int itsRefreshQueueSize = 0;
+  // Seconds the current time is rounded down to when no forecasttime is given
+  int itsForecastTimeResolution = 1;
+  // Persistent text cache, disabled if the directory is empty
+  std::string itsDiskCacheDirectory;
+  std::size_t itsDiskCacheSize = 0;  // bytes
+  // Store a compressed copy of each cached text for gzip and deflate responses
+  bool itsPrecompress = false;
+  // Limits for the freshness of responses, and the update interval of querydata
+  // assumed until an update has been observed, 0 if unknown
+  int itsMinFreshness = 0;
+  int itsMaxFreshness = 0;
+  int itsUpdateInterval = 0;
 
   Fmi::DirectoryMonitor itsMonitor;
   boost::thread itsMonitorThread;
@@ -187,11 +343,20 @@ class Config : private boost::noncopyable
               const std::filesystem::path& dir,
               const boost::regex& pattern,
               const Fmi::DirectoryMonitor::Status& status);
+  void updateDataVersion(const std::string& querydata,
+                         const Fmi::DirectoryMonitor::Status& status);
+  void monitorQuerydata(const ProductConfigMap& productConfigs);
   ConfigItemVector readMainConfig() const;
+  ConfigSnapshotPtr buildSnapshot(const ConfigItemVector& configItems,
+                                  const std::set<std::string>& deletedFiles,
+                                  const std::set<std::string>& modifiedFiles,
+                                  const std::set<std::string>& newFiles,
+                                  const ConfigSnapshot* previous);
   std::unique_ptr<ProductConfigMap> updateProductConfigs(const ConfigItemVector& configItems,
                                                          const std::set<std::string>& deletedFiles,
                                                          const std::set<std::string>& modifiedFiles,
-                                                         const std::set<std::string>& newFiles);
+                                                         const std::set<std::string>& newFiles,
+                                                         const ProductConfigMap* previousConfigs);
   std::set<std::string> getDirectoriesToMonitor(const ConfigItemVector& configItems) const;
   void setDefaultConfigValues(ProductConfigMap& productConfigs);
   std::unique_ptr<Engine::Gis::GeometryStorage> loadGeometries(
@@ -206,6 +371,10 @@ class Config : private boost::noncopyable
 
   SmartMet::Engine::Gis::Engine* itsGisEngine = nullptr;
 
+  // Querydata path -> versions, updated by the directory monitor
+  mutable std::mutex itsDataVersionMutex;
+  std::map<std::string, data_version> itsDataVersions;
+
   std::unique_ptr<Fmi::AsyncTask> config_update_task;
 };  // class Config
 
@@ -0,0 +1,552 @@
+// ======================================================================
+/*!
+ * \brief Implementation of class DiskCache
+ */
+// ======================================================================
+
+#include "DiskCache.h"
+#include <boost/crc.hpp>
+#include <boost/regex.hpp>
+#include <fcntl.h>
+#include <macgyver/Exception.h>
+#include <macgyver/StringConversion.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+namespace SmartMet
+{
+namespace Plugin
+{
+namespace Textgen
+{
+namespace
+{
+// Record: magic, key size, value size, checksum, stamp, key, value
+const std::uint32_t record_magic = 0x54474331;  // TGC1
+const std::size_t header_size = 4 * sizeof(std::uint32_t) + sizeof(std::int64_t);
+const std::size_t min_segment_bytes = 1024 * 1024;
+const std::size_t max_segment_bytes = 64 * 1024 * 1024;
+
+std::uint32_t checksum(const char* key,
+                       std::size_t key_size,
+                       const char* value,
+                       std::size_t value_size)
+{
+  boost::crc_32_type crc;
+  crc.process_bytes(key, key_size);
+  crc.process_bytes(value, value_size);
+  return crc.checksum();
+}
+
+std::string make_record(const std::string& key, const std::string& value, std::time_t stamp)
+{
+  const auto key_size = static_cast<std::uint32_t>(key.size());
+  const auto value_size = static_cast<std::uint32_t>(value.size());
+  const std::uint32_t crc = checksum(key.data(), key.size(), value.data(), value.size());
+  const auto stamp64 = static_cast<std::int64_t>(stamp);
+
+  std::string record(header_size, '\0');
+  char* ptr = &record[0];
+  std::memcpy(ptr, &record_magic, 4);
+  std::memcpy(ptr + 4, &key_size, 4);
+  std::memcpy(ptr + 8, &value_size, 4);
+  std::memcpy(ptr + 12, &crc, 4);
+  std::memcpy(ptr + 16, &stamp64, 8);
+  record.reserve(header_size + key.size() + value.size());
+  record += key;
+  record += value;
+  return record;
+}
+
+bool read_fully(int fd, char* buffer, std::size_t size, std::size_t offset)
+{
+  while (size > 0)
+  {
+    ssize_t n = pread(fd, buffer, size, static_cast<off_t>(offset));
+    if (n <= 0)
+      return false;
+    buffer += n;
+    size -= static_cast<std::size_t>(n);
+    offset += static_cast<std::size_t>(n);
+  }
+  return true;
+}
+
+bool write_fully(int fd, const char* buffer, std::size_t size, std::size_t offset)
+{
+  while (size > 0)
+  {
+    ssize_t n = pwrite(fd, buffer, size, static_cast<off_t>(offset));
+    if (n <= 0)
+      return false;
+    buffer += n;
+    size -= static_cast<std::size_t>(n);
+    offset += static_cast<std::size_t>(n);
+  }
+  return true;
+}
+
+}  // namespace
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Constructor
+ *
+ * Nothing is read or written until load has been called.
+ */
+// ----------------------------------------------------------------------
+
+DiskCache::DiskCache(std::filesystem::path directory, std::size_t max_bytes)
+    : itsDirectory(std::move(directory)),
+      itsMaxBytes(max_bytes),
+      itsSegmentBytes(std::clamp(max_bytes / 8, min_segment_bytes, max_segment_bytes)),
+      itsStartTime(Fmi::SecondClock::universal_time())
+{
+}
+
+DiskCache::~DiskCache()
+{
+  shutdown();
+}
+
+DiskCache::segment_file::~segment_file()
+{
+  close(fd);
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Start building the index in the background
+ *
+ * Until the index is ready all lookups miss and inserts are ignored. The
+ * same thread then writes the inserted texts.
+ */
+// ----------------------------------------------------------------------
+
+void DiskCache::load(const Validator& validator)
+{
+  try
+  {
+    std::filesystem::create_directories(itsDirectory);
+
+    itsTask = std::make_unique<Fmi::AsyncTask>(
+        "textgen-diskcache",
+        [this, validator]()
+        {
+          try
+          {
+            loadSegments(validator);
+            writeQueued();
+          }
+          catch (...)
+          {
+            Fmi::Exception::Trace(BCP, "Textgen disk cache failed").printError();
+          }
+        });
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!")
+        .addParameter("Directory", itsDirectory.string());
+  }
+}
+
+void DiskCache::shutdown()
+{
+  {
+    std::lock_guard<std::mutex> lock(itsQueueMutex);
+    itsStopping = true;
+  }
+  itsQueueCondition.notify_all();
+
+  if (itsTask)
+  {
+    try
+    {
+      itsTask->cancel();
+      itsTask->wait();
+    }
+    catch (...)
+    {
+      // The task reports its own errors
+    }
+    itsTask.reset();
+  }
+}
+
+std::filesystem::path DiskCache::segmentPath(std::uint64_t id) const
+{
+  return itsDirectory / ("segment-" + Fmi::to_string(id) + ".dat");
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Index the existing segments
+ *
+ * Later records of the same key replace earlier ones. A segment is
+ * truncated at the first damaged record, which is usually a write
+ * interrupted by a crash.
+ */
+// ----------------------------------------------------------------------
+
+void DiskCache::loadSegments(const Validator& validator)
+{
+  const boost::regex pattern("segment-([0-9]+)\\.dat");
+
+  std::vector<std::uint64_t> ids;
+  for (const auto& entry : std::filesystem::directory_iterator(itsDirectory))
+  {
+    boost::smatch match;
+    const std::string name = entry.path().filename().string();
+    if (boost::regex_match(name, match, pattern))
+      ids.push_back(std::stoull(match[1]));
+  }
+  std::sort(ids.begin(), ids.end());
+
+  std::map<std::uint64_t, segment> segments;
+  std::unordered_map<std::string, location> index;
+  std::size_t total_bytes = 0;
+
+  for (auto id : ids)
+  {
+    Fmi::AsyncTask::interruption_point();
+
+    const std::string path = segmentPath(id).string();
+    const int fd = open(path.c_str(), O_RDWR | O_CLOEXEC);
+    if (fd < 0)
+      continue;
+    segment seg;
+    seg.file = std::make_shared<segment_file>(fd);
+
+    const auto file_size = static_cast<std::size_t>(std::filesystem::file_size(path));
+    std::size_t offset = 0;
+    std::string key;
+    std::string value;
+    char header[header_size];
+
+    while (offset + header_size <= file_size && read_fully(fd, header, header_size, offset))
+    {
+      std::uint32_t magic = 0;
+      location loc;
+      std::uint32_t crc = 0;
+      std::int64_t stamp = 0;
+      std::memcpy(&magic, header, 4);
+      std::memcpy(&loc.key_size, header + 4, 4);
+      std::memcpy(&loc.value_size, header + 8, 4);
+      std::memcpy(&crc, header + 12, 4);
+      std::memcpy(&stamp, header + 16, 8);
+
+      const std::size_t record_size = header_size + loc.key_size + loc.value_size;
+      if (magic != record_magic || offset + record_size > file_size)
+        break;
+
+      key.resize(loc.key_size);
+      value.resize(loc.value_size);
+      if (!read_fully(fd, &key[0], key.size(), offset + header_size) ||
+          !read_fully(fd, &value[0], value.size(), offset + header_size + key.size()) ||
+          checksum(key.data(), key.size(), value.data(), value.size()) != crc)
+        break;
+
+      loc.segment = id;
+      loc.offset = offset;
+      loc.stamp = static_cast<std::time_t>(stamp);
+
+      if (validator(key, loc.stamp))
+      {
+        auto pos = index.find(key);
+        if (pos != index.end())
+        {
+          const location& old = pos->second;
+          const std::size_t old_size = header_size + old.key_size + old.value_size;
+          if (old.segment == id)
+            seg.live_bytes -= old_size;
+          else
+            segments[old.segment].live_bytes -= old_size;
+          pos->second = loc;
+        }
+        else
+        {
+          index.insert(std::make_pair(key, loc));
+        }
+        seg.live_bytes += record_size;
+      }
+      offset += record_size;
+    }
+
+    // The index may already refer to the segment, so it is kept even if the
+    // damaged tail cannot be cut off. Later records overwrite the tail.
+    if (offset < file_size && ftruncate(fd, static_cast<off_t>(offset)) != 0)
+    {
+    }
+
+    seg.bytes = offset;
+    total_bytes += offset;
+    segments[id] = seg;
+  }
+
+  // Only the final location of each key is live
+  for (const auto& item : index)
+    segments[item.second.segment].keys.push_back(&item.first);
+
+  {
+    std::lock_guard<std::mutex> lock(itsMutex);
+    itsSegments.swap(segments);
+    itsIndex.swap(index);
+    itsTotalBytes = total_bytes;
+  }
+  maintain();
+  itsLoaded = true;
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Write queued texts until shutdown
+ *
+ * Maintenance is done after each batch, so lookups never wait for it.
+ */
+// ----------------------------------------------------------------------
+
+void DiskCache::writeQueued()
+{
+  while (true)
+  {
+    std::deque<pending_text> texts;
+    {
+      std::unique_lock<std::mutex> lock(itsQueueMutex);
+      itsQueueCondition.wait(lock, [this]() { return itsStopping || !itsQueue.empty(); });
+      if (itsStopping)
+        return;
+      texts.swap(itsQueue);
+      itsQueueBytes = 0;
+    }
+
+    try
+    {
+      for (const auto& text : texts)
+        append(text.key, text.value, text.stamp);
+      maintain();
+    }
+    catch (...)
+    {
+      Fmi::Exception::Trace(BCP, "Writing textgen disk cache failed").printError();
+    }
+  }
+}
+
+std::optional<std::string> DiskCache::find(const std::string& key)
+{
+  try
+  {
+    if (!itsLoaded)
+      return {};
+
+    location loc;
+    std::shared_ptr<segment_file> file;
+    {
+      std::lock_guard<std::mutex> lock(itsMutex);
+      auto pos = itsIndex.find(key);
+      if (pos == itsIndex.end())
+      {
+        ++itsMisses;
+        return {};
+      }
+      loc = pos->second;
+      file = itsSegments.at(loc.segment).file;
+    }
+
+    // Records are never modified once written, and a dropped segment stays
+    // open until its last reader is done
+    ++itsHits;
+    return readValue(*file, loc);
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+std::string DiskCache::readValue(const segment_file& file, const location& loc) const
+{
+  std::string value(loc.value_size, '\0');
+  if (!read_fully(file.fd, &value[0], value.size(), loc.offset + header_size + loc.key_size))
+    throw Fmi::Exception(BCP, "Failed to read textgen disk cache segment")
+        .addParameter("Segment", segmentPath(loc.segment).string());
+  return value;
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Queue a text for writing
+ *
+ * Texts are dropped rather than queued without limit if the disk cannot
+ * keep up, they have already been served from memory.
+ */
+// ----------------------------------------------------------------------
+
+void DiskCache::insert(const std::string& key, const std::string& value, std::time_t stamp)
+{
+  const std::size_t record_size = header_size + key.size() + value.size();
+  if (!itsLoaded || record_size > itsSegmentBytes)
+    return;
+
+  {
+    std::lock_guard<std::mutex> lock(itsQueueMutex);
+    if (itsStopping || itsQueueBytes + record_size > itsSegmentBytes)
+      return;
+    itsQueue.push_back(pending_text{key, value, stamp});
+    itsQueueBytes += record_size;
+  }
+  ++itsInserts;
+  itsQueueCondition.notify_one();
+}
+
+// The segment to append a record to, a new one if the newest one is full
+std::uint64_t DiskCache::activeSegment(std::size_t record_size)
+{
+  if (!itsSegments.empty() && itsSegments.rbegin()->second.bytes + record_size <= itsSegmentBytes)
+    return itsSegments.rbegin()->first;
+
+  const std::uint64_t id = (itsSegments.empty() ? 1 : itsSegments.rbegin()->first + 1);
+  const std::string path = segmentPath(id).string();
+
+  const int fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd < 0)
+    throw Fmi::Exception(BCP, "Failed to create textgen disk cache segment")
+        .addParameter("Segment", path);
+
+  segment seg;
+  seg.file = std::make_shared<segment_file>(fd);
+  std::lock_guard<std::mutex> lock(itsMutex);
+  itsSegments[id] = seg;
+  return id;
+}
+
+void DiskCache::append(const std::string& key, const std::string& value, std::time_t stamp)
+{
+  const std::string record = make_record(key, value, stamp);
+  const std::uint64_t id = activeSegment(record.size());
+  segment& seg = itsSegments.at(id);
+
+  // Lookups see the record only after it has been written
+  if (!write_fully(seg.file->fd, record.data(), record.size(), seg.bytes))
+  {
+    // Do not leave a partial record in the middle of the segment
+    if (ftruncate(seg.file->fd, static_cast<off_t>(seg.bytes)) != 0)
+    {
+      // The damaged tail is cut off when the segment is next loaded
+    }
+    throw Fmi::Exception(BCP, "Failed to write textgen disk cache segment");
+  }
+
+  location loc;
+  loc.segment = id;
+  loc.offset = seg.bytes;
+  loc.key_size = static_cast<std::uint32_t>(key.size());
+  loc.value_size = static_cast<std::uint32_t>(value.size());
+  loc.stamp = stamp;
+
+  std::lock_guard<std::mutex> lock(itsMutex);
+  auto pos = itsIndex.find(key);
+  if (pos != itsIndex.end())
+  {
+    const location& old = pos->second;
+    itsSegments[old.segment].live_bytes -= header_size + old.key_size + old.value_size;
+    pos->second = loc;
+  }
+  else
+  {
+    pos = itsIndex.insert(std::make_pair(key, loc)).first;
+  }
+
+  seg.keys.push_back(&pos->first);
+  seg.bytes += record.size();
+  seg.live_bytes += record.size();
+  itsTotalBytes += record.size();
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Keep the segments within the byte limit and mostly live
+ */
+// ----------------------------------------------------------------------
+
+void DiskCache::maintain()
+{
+  while (itsTotalBytes > itsMaxBytes && itsSegments.size() > 1)
+    dropSegment(itsSegments.begin()->first);
+
+  if (itsSegments.size() > 1)
+  {
+    const auto& oldest = *itsSegments.begin();
+    if (2 * oldest.second.live_bytes < oldest.second.bytes)
+      compactSegment(oldest.first);
+  }
+}
+
+void DiskCache::dropSegment(std::uint64_t id)
+{
+  {
+    std::lock_guard<std::mutex> lock(itsMutex);
+    segment& seg = itsSegments.at(id);
+    for (const auto* key : seg.keys)
+    {
+      auto pos = itsIndex.find(*key);
+      if (pos != itsIndex.end() && pos->second.segment == id)
+        itsIndex.erase(pos);
+    }
+
+    itsTotalBytes -= seg.bytes;
+    itsSegments.erase(id);
+  }
+
+  std::error_code ec;
+  std::filesystem::remove(segmentPath(id), ec);
+}
+
+void DiskCache::compactSegment(std::uint64_t id)
+{
+  std::vector<std::pair<std::string, location>> records;
+  std::shared_ptr<segment_file> file;
+  {
+    std::lock_guard<std::mutex> lock(itsMutex);
+    const segment& seg = itsSegments.at(id);
+    file = seg.file;
+    for (const auto* key : seg.keys)
+    {
+      auto pos = itsIndex.find(*key);
+      if (pos != itsIndex.end() && pos->second.segment == id)
+        records.emplace_back(*key, pos->second);
+    }
+  }
+
+  for (const auto& record : records)
+  {
+    Fmi::AsyncTask::interruption_point();
+    append(record.first, readValue(*file, record.second), record.second.stamp);
+  }
+
+  dropSegment(id);
+}
+
+Fmi::Cache::CacheStats DiskCache::statistics() const
+{
+  Fmi::Cache::CacheStats stats;
+  stats.starttime = itsStartTime;
+  stats.maxsize = itsMaxBytes;
+  {
+    std::lock_guard<std::mutex> lock(itsMutex);
+    stats.size = itsIndex.size();
+  }
+  stats.hits = itsHits;
+  stats.misses = itsMisses;
+  stats.inserts = itsInserts;
+  return stats;
+}
+
+}  // namespace Textgen
+}  // namespace Plugin
+}  // namespace SmartMet
+
+// ======================================================================
@@ -0,0 +1,140 @@
+// ======================================================================
+/*!
+ * \brief Persistent second level cache for formatted texts
+ *
+ * Texts are appended to segment files in a directory. An index of the
+ * segments is built in the background at startup, entries rejected by
+ * the validator (for example texts of outdated querydata) are skipped.
+ * When the segments exceed the byte limit the oldest one is dropped, and
+ * a segment which is mostly garbage is compacted by copying its live
+ * entries to the newest segment.
+ *
+ * All writing, dropping and compaction is done by a single background
+ * thread, inserts only queue the texts. Lookups hold the lock only while
+ * searching the index, the file is read after the lock is released.
+ */
+// ======================================================================
+
+#pragma once
+
+#include <boost/noncopyable.hpp>
+#include <macgyver/AsyncTask.h>
+#include <macgyver/CacheStats.h>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <ctime>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace SmartMet
+{
+namespace Plugin
+{
+namespace Textgen
+{
+class DiskCache : private boost::noncopyable
+{
+ public:
+  // Returns false for entries which must not be loaded
+  using Validator = std::function<bool(const std::string& key, std::time_t stamp)>;
+
+  DiskCache(std::filesystem::path directory, std::size_t max_bytes);
+  ~DiskCache();
+
+  void load(const Validator& validator);
+  void shutdown();
+
+  std::optional<std::string> find(const std::string& key);
+  void insert(const std::string& key, const std::string& value, std::time_t stamp);
+
+  // Hits and misses are counted only after the index has been loaded
+  Fmi::Cache::CacheStats statistics() const;
+
+ private:
+  // Closed when the last reader of a dropped segment is done with it
+  struct segment_file
+  {
+    explicit segment_file(int theFd) : fd(theFd) {}
+    segment_file(const segment_file& other) = delete;
+    segment_file& operator=(const segment_file& other) = delete;
+    ~segment_file();
+    const int fd;
+  };
+
+  struct segment
+  {
+    std::shared_ptr<segment_file> file;
+    std::size_t bytes = 0;       // size of the file
+    std::size_t live_bytes = 0;  // size of the records still in the index
+    // Keys of the index appended to this segment, some may since have moved to
+    // newer segments. Segments are dropped oldest first, so the keys are valid.
+    std::vector<const std::string*> keys;
+  };
+
+  struct location
+  {
+    std::uint64_t segment = 0;
+    std::size_t offset = 0;  // of the record
+    std::uint32_t key_size = 0;
+    std::uint32_t value_size = 0;
+    std::time_t stamp = 0;
+  };
+
+  struct pending_text
+  {
+    std::string key;
+    std::string value;
+    std::time_t stamp = 0;
+  };
+
+  void loadSegments(const Validator& validator);
+  void writeQueued();
+  std::filesystem::path segmentPath(std::uint64_t id) const;
+  std::uint64_t activeSegment(std::size_t record_size);
+  void append(const std::string& key, const std::string& value, std::time_t stamp);
+  void maintain();
+  void dropSegment(std::uint64_t id);
+  void compactSegment(std::uint64_t id);
+  std::string readValue(const segment_file& file, const location& loc) const;
+
+  const std::filesystem::path itsDirectory;
+  const std::size_t itsMaxBytes;
+  const std::size_t itsSegmentBytes;
+
+  // Guards the index and the segments. Only the background thread modifies
+  // them, hence it may read them without the lock.
+  mutable std::mutex itsMutex;
+  std::map<std::uint64_t, segment> itsSegments;
+  std::unordered_map<std::string, location> itsIndex;
+  std::size_t itsTotalBytes = 0;
+
+  // Texts waiting to be written, limited to the size of one segment
+  std::mutex itsQueueMutex;
+  std::condition_variable itsQueueCondition;
+  std::deque<pending_text> itsQueue;
+  std::size_t itsQueueBytes = 0;
+  bool itsStopping = false;
+
+  std::atomic<bool> itsLoaded{false};
+  std::unique_ptr<Fmi::AsyncTask> itsTask;
+
+  Fmi::DateTime itsStartTime;
+  std::atomic<std::size_t> itsHits{0};
+  std::atomic<std::size_t> itsMisses{0};
+  std::atomic<std::size_t> itsInserts{0};
+};
+
+}  // namespace Textgen
+}  // namespace Plugin
+}  // namespace SmartMet
+
+// ======================================================================
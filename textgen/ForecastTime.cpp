@@ -0,0 +1,51 @@
+// ======================================================================
+/*!
+ * \brief Implementation of forecast times of requests
+ */
+// ======================================================================
+
+#include "ForecastTime.h"
+
+namespace SmartMet
+{
+namespace Plugin
+{
+namespace Textgen
+{
+// ----------------------------------------------------------------------
+/*!
+ * \brief Round a time down to a multiple of the resolution
+ *
+ * Multiples are counted from the epoch, so a resolution which divides an
+ * hour is aligned with full hours.
+ */
+// ----------------------------------------------------------------------
+
+std::time_t round_forecasttime(std::time_t t, int resolution)
+{
+  if (resolution <= 1)
+    return t;
+  return t - t % resolution;
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Seconds until the next multiple of the resolution
+ *
+ * Responses made for the rounded time are made for a different time
+ * after this, so they must not be fresh any longer.
+ */
+// ----------------------------------------------------------------------
+
+int seconds_until_next_forecasttime(std::time_t t, int resolution)
+{
+  if (resolution <= 1)
+    return 1;
+  return static_cast<int>(resolution - t % resolution);
+}
+
+}  // namespace Textgen
+}  // namespace Plugin
+}  // namespace SmartMet
+
+// ======================================================================
@@ -0,0 +1,31 @@
+// ======================================================================
+/*!
+ * \brief Forecast times of requests without a forecasttime parameter
+ *
+ * Such requests are made for the current time rounded down to the
+ * configured resolution, so that the texts can be shared by all requests
+ * until the next multiple of the resolution.
+ */
+// ======================================================================
+
+#pragma once
+
+#include <ctime>
+
+namespace SmartMet
+{
+namespace Plugin
+{
+namespace Textgen
+{
+// The time rounded down to a multiple of the resolution in seconds
+std::time_t round_forecasttime(std::time_t t, int resolution);
+
+// Seconds until the rounded time changes, at least one
+int seconds_until_next_forecasttime(std::time_t t, int resolution);
+
+}  // namespace Textgen
+}  // namespace Plugin
+}  // namespace SmartMet
+
+// ======================================================================
@@ -1,7 +1,9 @@
 #include "Plugin.h"
+#include "BBox.h"
 #include "DatabaseDictionariesPlusGeonames.h"
 #include "FileDictionariesPlusGeonames.h"
 #include "FileDictionaryPlusGeonames.h"
+#include "ForecastTime.h"
 #include "PoDictionariesPlusGeonames.h"
 #include <boost/lexical_cast.hpp>
 #include <calculator/Settings.h>
@@ -10,6 +12,7 @@
 #include <engines/gis/Normalize.h>
 #include <macgyver/Exception.h>
 #include <macgyver/TimeFormatter.h>
+#include <macgyver/TimeParser.h>
 #include <spine/Convenience.h>
 #include <spine/Location.h>
 #include <spine/Thread.h>
@@ -18,6 +21,16 @@
 #include <textgen/TextFormatter.h>
 #include <textgen/TextFormatterFactory.h>
 #include <textgen/TextGenerator.h>
+#include <json/json.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdio>
+#include <exception>
+#include <iomanip>
+#include <sstream>
 
 namespace SmartMet
 {
@@ -46,10 +59,17 @@ namespace Textgen
 #define POSTGIS_TABLE_PARAM "table"
 #define POSTGIS_FIELD_PARAM "field"
 #define POSTGIS_CLIENT_ENCODING_PARAM "client_encoding"
+#define BATCH_JOB_ID "id"
 
 namespace
 {
-SmartMet::Spine::MutexType gDictionaryMutex;
+// Parameters which may affect the resolved locations of a request, the
+// Geonames engine parses all but areasource
+const char* const location_params[] = {
+    "area", "areas", "place", "places", "path", "paths", "bbox", "bboxes", "wkt",
+    "lonlat", "lonlats", "latlon", "latlons", "radius", "maxdistance",
+    "geoid", "geoids", "fmisid", "lpnn", "wmo", "keyword", "inkeyword", "feature",
+    "areasource"};
 
 std::string mmap_string(const SmartMet::Spine::HTTP::ParamMap& mmap,
                         const std::string& key,
@@ -101,19 +121,136 @@ bool parse_forecasttime_parameter(const std::string& forecasttime_string,
   }
 }
 
+// ----------------------------------------------------------------------
+/*!
+ * \brief Resolve a WKT location into an area
+ *
+ * The WKT geometries of the request are parsed only once, and only if
+ * some WKT location is not already in the cache.
+ */
+// ----------------------------------------------------------------------
+
+std::shared_ptr<const wkt_area> make_wkt_area(
+    const Spine::Location& loc,
+    const Spine::TaggedLocationList& tagged_locations,
+    const SmartMet::Engine::Geonames::Engine& geoEngine,
+    const std::string& language,
+    std::optional<Engine::Geonames::WktGeometries>& wktGeometries,
+    WktAreaCache& wktAreaCache,
+    std::string& errorMessage)
+{
+  try
+  {
+    // Map clients send the same polygons again and again
+    const std::uint64_t wkt_hash =
+        stable_hash_combine(stable_hash(loc.name), std::hash<double>()(loc.radius));
+    auto cached = wktAreaCache.find(wkt_hash);
+    if (cached && (*cached)->wkt == loc.name && (*cached)->radius == loc.radius)
+      return *cached;
+
+    if (!wktGeometries)
+      wktGeometries = geoEngine.getWktGeometries(tagged_locations, language);
+
+    Spine::LocationPtr wktLocation = wktGeometries->getLocation(loc.name);
+    Spine::Location::LocationType wktType = wktLocation->type;
+    std::string wktName = loc.name;
+    size_t wktNamePos = wktName.find(" as ");
+    if (wktNamePos != std::string::npos)
+      wktName = wktName.substr(wktNamePos + 4);
+
+    std::shared_ptr<wkt_area> ret;
+    switch (wktType)
+    {
+      case Spine::Location::LocationType::CoordinatePoint:
+      {
+        int coordinate_string_len = (loc.name.find(')') - loc.name.find('(')) - 1;
+        std::string coordinates = loc.name.substr(loc.name.find('(') + 1, coordinate_string_len);
+        double lon = Fmi::stod(coordinates.substr(0, coordinates.find(' ')));
+        double lat = Fmi::stod(coordinates.substr(coordinates.find(' ') + 1));
+        ret = std::make_shared<wkt_area>(
+            wkt_area{loc.name,
+                     loc.radius,
+                     wktName + "_wkt1",
+                     TextGen::WeatherArea(NFmiPoint(lon, lat),
+                                          wktName,
+                                          (loc.radius && loc.radius >= 5.0) ? loc.radius : 0.0)});
+        break;
+      }
+      case Spine::Location::LocationType::Area:
+      case Spine::Location::LocationType::Path:
+      {
+        ret = std::make_shared<wkt_area>(
+            wkt_area{loc.name,
+                     loc.radius,
+                     wktName + "_wkt2",
+                     TextGen::WeatherArea(wktGeometries->getSvgPath(loc.name), wktName)});
+        break;
+      }
+      default:
+      {
+        std::cout << "WKT type not supported: " << wktType << '\n';
+        errorMessage += "WKT type not supported";
+        return {};
+      }
+    }
+
+    wktAreaCache.insert(wkt_hash, ret);
+    return ret;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Build the rectangle of a bbox parameter without a WKT round trip
+ *
+ * The area is identical to the one the Geonames engine would make of the
+ * equivalent WKT polygon, including its id and name.
+ */
+// ----------------------------------------------------------------------
+
+std::pair<std::string, TextGen::WeatherArea> make_bbox_area(const std::vector<std::string>& parts,
+                                                            const std::string& name)
+{
+  try
+  {
+    return std::make_pair(name + "_wkt2", TextGen::WeatherArea(make_bbox_path(parts), name));
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// The configured area containing a point without a radius, if any
+const AreaIndex::Area* find_point_area(const AreaIndex* pointAreas, const Spine::Location& loc)
+{
+  // Radii under 5 km are ignored when the point area is made
+  if (!pointAreas || (loc.radius && loc.radius >= 5.0))
+    return nullptr;
+  return pointAreas->find(loc.longitude, loc.latitude);
+}
+
 bool parse_location_parameters(
     const Spine::HTTP::Request& theRequest,
-    const Config& config,
+    const ConfigSnapshot& config,
     const SmartMet::Engine::Geonames::Engine& geoEngine,
     const std::string& language,
-    std::vector<std::pair<std::string, TextGen::WeatherArea>>& weatherAreaVector,
+    const AreaIndex* pointAreas,
+    WktAreaCache& wktAreaCache,
+    LocationAreas& weatherAreaVector,
     std::string& errorMessage)
 {
   try
   {
     Spine::HTTP::Request httpRequest = theRequest;
 
-    // If bbox-parameter exists, convert it to wkt-parameter
+    // A bbox is built into an area directly. With a radius it is converted to
+    // a wkt-parameter instead, since the Geonames engine expands the polygon.
+    std::optional<std::pair<std::string, TextGen::WeatherArea>> bbox_area;
     std::optional<std::string> bbox_param_value = httpRequest.getParameter("bbox");
     if (bbox_param_value)
     {
@@ -139,24 +276,27 @@ bool parse_location_parameters(
                              "Invalid bbox parameter " + bbox_string +
                                  ", should be in format 'lon,lat,lon,lat[:radius] [as name]'!");
 
-      std::string wktString("POLYGON((");
-      wktString += (parts[0] + " " + parts[1] + ", ");
-      wktString += (parts[0] + " " + parts[3] + ", ");
-      wktString += (parts[2] + " " + parts[3] + ", ");
-      wktString += (parts[2] + " " + parts[1] + ", ");
-      wktString += (parts[0] + " " + parts[1] + "))");
-      if (!radius.empty())
-        wktString += (":" + radius);
-      if (!bbox_name.empty())
-        wktString += (" as " + bbox_name);
+      std::string wktString = make_bbox_wkt(parts);
 
       httpRequest.removeParameter("bbox");
-      httpRequest.setParameter("wkt", wktString);
+      if (radius.empty())
+      {
+        // The bbox replaces any wkt-parameter just like when converted
+        httpRequest.removeParameter("wkt");
+        bbox_area = make_bbox_area(parts, (bbox_name.empty() ? wktString : bbox_name));
+      }
+      else
+      {
+        wktString += (":" + radius);
+        if (!bbox_name.empty())
+          wktString += (" as " + bbox_name);
+        httpRequest.setParameter("wkt", wktString);
+      }
     }
 
     auto tagged_locations = geoEngine.parseLocations(httpRequest);
 
-    if (tagged_locations.empty())
+    if (tagged_locations.empty() && !bbox_area)
     {
       errorMessage += "No locations specified";
       return false;
@@ -166,6 +306,13 @@ bool parse_location_parameters(
     if (!areasource)
       areasource = "";
 
+    // Point areas are of one areasource
+    if (pointAreas && pointAreas->areaSource() != *areasource)
+      pointAreas = nullptr;
+
+    // Parsed on first use and then shared by all WKT locations of the request
+    std::optional<Engine::Geonames::WktGeometries> wktGeometries;
+
     for (const auto& tagged_loc : tagged_locations.locations())
     {
       const auto& loc = *tagged_loc.loc;
@@ -179,6 +326,8 @@ bool parse_location_parameters(
           if (loc.feature.substr(0, 3) == "ADM" && config.geoObjectExists(loc.name, *areasource))
             weatherAreaVector.emplace_back(loc.name + *areasource + "_place1",
                                            config.makePostGisArea(loc.name, *areasource));
+          else if (const auto* pointArea = find_point_area(pointAreas, loc))
+            weatherAreaVector.push_back(*pointArea);
           else
           {
             auto geoname = loc.name;
@@ -218,46 +367,16 @@ bool parse_location_parameters(
         }
         case Spine::Location::LocationType::Wkt:
         {
-          Engine::Geonames::WktGeometries wktGeometries =
-              geoEngine.getWktGeometries(tagged_locations, language);
-
-          Spine::LocationPtr wktLocation = wktGeometries.getLocation(loc.name);
-          Spine::Location::LocationType wktType = wktLocation->type;
-          //        TextGen::WeatherArea wktWeatherArea(NFmiPoint(0.0, 0.0));
-          std::string wktName = loc.name;
-          size_t wktNamePos = wktName.find(" as ");
-          if (wktNamePos != std::string::npos)
-            wktName = wktName.substr(wktNamePos + 4);
-          switch (wktType)
-          {
-            case Spine::Location::LocationType::CoordinatePoint:
-            {
-              int coordinate_string_len = (loc.name.find(')') - loc.name.find('(')) - 1;
-              std::string coordinates =
-                  loc.name.substr(loc.name.find('(') + 1, coordinate_string_len);
-              double lon = Fmi::stod(coordinates.substr(0, coordinates.find(' ')));
-              double lat = Fmi::stod(coordinates.substr(coordinates.find(' ') + 1));
-              weatherAreaVector.emplace_back(
-                  wktName + "_wkt1",
-                  TextGen::WeatherArea(NFmiPoint(lon, lat),
-                                       wktName,
-                                       (loc.radius && loc.radius >= 5.0) ? loc.radius : 0.0));
-              break;
-            }
-            case Spine::Location::LocationType::Area:
-            case Spine::Location::LocationType::Path:
-            {
-              weatherAreaVector.emplace_back(
-                  wktName + "_wkt2",
-                  TextGen::WeatherArea(wktGeometries.getSvgPath(loc.name), wktName));
-              break;
-            }
-            default:
-            {
-              std::cout << "WKT type not supported: " << wktType << '\n';
-              return false;
-            }
-          }
+          auto area = make_wkt_area(loc,
+                                    tagged_locations,
+                                    geoEngine,
+                                    language,
+                                    wktGeometries,
+                                    wktAreaCache,
+                                    errorMessage);
+          if (!area)
+            return false;
+          weatherAreaVector.emplace_back(area->area_id, area->area);
           break;
         }
         case Spine::Location::LocationType::Path:
@@ -268,6 +387,9 @@ bool parse_location_parameters(
       }
     }
 
+    if (bbox_area)
+      weatherAreaVector.push_back(std::move(*bbox_area));
+
     return true;
   }
   catch (...)
@@ -301,92 +423,712 @@ std::string get_setting_string(const std::string& key,
   return default_value;
 }
 
+// Generation of the product settings installed into the Settings of this thread,
+// zero whenever the Settings of the thread have been released
+thread_local std::size_t installed_settings = 0;
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Install the settings of the product for the current thread
+ *
+ * Settings are thread local. Threads of the plugin's own pools keep them
+ * between tasks, hence a pool thread serving the same product again needs
+ * to set only the overridable ones. Server threads are shared with other
+ * plugins and release them at the end of each request.
+ *
+ * Settings must only be released with release_textgen_settings, which
+ * resets installed_settings. Otherwise a thread would believe the fixed
+ * settings of a product are still installed after they are gone.
+ */
+// ----------------------------------------------------------------------
+
 void set_textgen_settings(const ProductConfig& config,
                           const SmartMet::Spine::HTTP::ParamMap& params,
                           std::string& modified_params)
 {
   try
   {
-#ifdef MYDEBUG
-    std::cout << "*** Test generator settings ***\n";
-#endif
-    // frostseason-parameter is used by old stories
-    Settings::set("textgen::frostseason", (config.isFrostSeason() ? "true" : "false"));
+    const product_settings& settings = config.settings();
+
+    if (installed_settings != settings.generation)
+    {
+      Settings::release();
+      installed_settings = 0;
+      for (const auto& item : settings.fixed)
+        Settings::set(item.first, item.second);
+      installed_settings = settings.generation;
+    }
+
+    for (const auto& item : settings.overridable)
+      Settings::set(item.name, get_setting_string(item.key, item.value, params, modified_params));
+  }
+  catch (...)
+  {
+    installed_settings = 0;
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// Delete the textgen settings of the current thread
+void release_textgen_settings()
+{
+  Settings::release();
+  installed_settings = 0;
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Helpers of one request in the shared area pool
+ *
+ * Helpers refer to the state of the request, so the request waits for the
+ * helpers which have started. Helpers which start after that do nothing.
+ */
+// ----------------------------------------------------------------------
+
+struct area_helpers
+{
+  std::mutex mutex;
+  std::condition_variable finished;
+  bool closed = false;
+  std::size_t active = 0;
+  std::exception_ptr error;
+  std::vector<std::string> logs;  // merged into the log of the request
+
+  bool start()
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (closed)
+      return false;
+    ++active;
+    return true;
+  }
+
+  void finish(std::string log, std::exception_ptr err)
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    logs.push_back(std::move(log));
+    if (err && !error)
+      error = err;
+    --active;
+    finished.notify_all();
+  }
 
-    // Parameter mappings
-    ParameterMappings pm = config.getParameterMappings();
-    for (const auto& item : pm)
-      Settings::set(item.first, item.second);
+  void close()
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    closed = true;
+    finished.wait(lock, [this]() { return active == 0; });
+  }
+};
 
-    // forecasts and the querydata
-    for (unsigned int i = 0; i < config.numberOfForecastDataConfigs(); i++)
+// Closes the helpers however the request ends
+class area_helpers_guard
+{
+ public:
+  explicit area_helpers_guard(std::shared_ptr<area_helpers> helpers)
+      : itsHelpers(std::move(helpers))
+  {
+  }
+  area_helpers_guard(const area_helpers_guard& other) = delete;
+  area_helpers_guard& operator=(const area_helpers_guard& other) = delete;
+  ~area_helpers_guard() { itsHelpers->close(); }
+
+ private:
+  std::shared_ptr<area_helpers> itsHelpers;
+};
+
+std::shared_ptr<TextGen::Dictionary> create_dictionary(const std::string& dictionary_name)
+{
+  try
+  {
+    if (dictionary_name == "multimysqlplusgeonames")
+      return std::make_shared<DatabaseDictionariesPlusGeonames>("mysql");
+    if (dictionary_name == "multipostgresqlplusgeonames")
+      return std::make_shared<DatabaseDictionariesPlusGeonames>("postgresql");
+    if (dictionary_name == "multifileplusgeonames")
+      return std::make_shared<FileDictionariesPlusGeonames>();
+    if (dictionary_name == "multipoplusgeonames")
+      return std::make_shared<PoDictionariesPlusGeonames>();
+
+    return static_cast<std::shared_ptr<TextGen::Dictionary>>(
+        (TextGen::DictionaryFactory::create(dictionary_name)));
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!")
+        .addParameter("dictionary", dictionary_name);
+  }
+}
+
+TextGen::TextGenerator make_generator(const WeatherAreas& theMaskContainer)
+{
+  bool masksExists(theMaskContainer.find(LAND_MASK_NAME) != theMaskContainer.end() &&
+                   theMaskContainer.find(COAST_MASK_NAME) != theMaskContainer.end());
+
+  if (masksExists)
+    return TextGen::TextGenerator(theMaskContainer.at(LAND_MASK_NAME),
+                                  theMaskContainer.at(COAST_MASK_NAME));
+  return TextGen::TextGenerator();
+}
+
+// Part of the cache keys identifying the querydata version
+std::string data_version_key(std::uint64_t id)
+{
+  return "data" + Fmi::to_string(id);
+}
+
+// True if the text was generated from the current querydata of its product
+bool is_current_text(const Config& config, const std::string& key, std::time_t stamp)
+{
+  // Cache keys start with the product parameter
+  std::string product_name = key.substr(0, key.find(';'));
+  if (product_name.empty())
+    product_name = DEFAULT_PRODUCT_NAME;
+
+  const ConfigSnapshotPtr snapshot = config.snapshot();
+  if (stamp <= 0 || !snapshot->productConfigExists(product_name))
+    return false;
+
+  // The stamp is the time of the querydata, the key contains its exact version
+  const data_version version = config.getDataVersion(snapshot->getProductConfig(product_name));
+  return (version.current == stamp &&
+          key.find(";" + data_version_key(version.id) + ";") != std::string::npos);
+}
+
+void handle_exception(const SmartMet::Spine::HTTP::Request& theRequest,
+                      SmartMet::Spine::HTTP::Response& theResponse,
+                      const std::string& what,
+                      const std::string& log,
+                      SmartMet::Spine::HTTP::Status debugStatus,
+                      bool isdebug)
+{
+  try
+  {
+    std::cerr << Spine::log_time_str() << " error: " << what << '\n'
+              << "Query: " << theRequest.getURI() << '\n'
+              << "ClientIP: " << theRequest.getClientIP() << '\n';
+
+    if (isdebug)
     {
-      const auto& forecast_item = config.getForecastDataConfig(i);
-      Settings::set("textgen::" + forecast_item.first, forecast_item.second);
-#ifdef MYDEBUG
-      if (i == 0)
-        std::cout << "Querydata:\n";
-      std::cout << "textgen::" + forecast_item.first << "=" << forecast_item.second << '\n';
-#endif
+      std::string msg = "Error: " + what;
+      theResponse.setContent(msg + "\n\n" + log);
+      theResponse.setStatus(debugStatus);
+    }
+    else
+    {
+      theResponse.setStatus(SmartMet::Spine::HTTP::Status::internal_server_error);
     }
 
-    // unit formats
-    for (unsigned int i = 0; i < config.numberOfUnitFormatConfigs(); i++)
+    // Remove newlines, make sure length is reasonable
+    std::string msg = what;
+    boost::algorithm::replace_all(msg, "\n", " ");
+    msg = msg.substr(0, 100);
+    theResponse.setHeader("X-TextGen-Error", msg);
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// Parameters whose values are lists of coordinates, each optionally followed by :radius
+const char* const coordinate_params[] = {"lonlat", "lonlats", "latlon", "latlons"};
+
+// Snap a list of coordinates to the grid. Invalid values are left for the geonames
+// engine to report.
+std::string snap_coordinates(const std::string& value, double grid)
+{
+  try
+  {
+    // Enough decimals to represent the grid points exactly
+    int decimals = 0;
+    for (double g = grid; decimals < 6 && std::abs(g - std::round(g)) > 1e-9; g *= 10)
+      decimals++;
+
+    std::vector<std::string> parts;
+    boost::algorithm::split(parts, value, boost::algorithm::is_any_of(","));
+
+    std::string ret;
+    for (const auto& part : parts)
     {
-      const auto& unit_format_item = config.getUnitFormatConfig(i);
-      std::string setting_string = get_setting_string(
-          unit_format_item.first, unit_format_item.second, params, modified_params);
+      const auto pos = part.find(':');
+      const std::string number = part.substr(0, pos);
+      const std::string suffix = (pos == std::string::npos ? "" : part.substr(pos));
 
-      Settings::set("textgen::units::" + unit_format_item.first + "::format", setting_string);
-#ifdef MYDEBUG
-      if (i == 0)
-        std::cout << "\nUnits:\n" std::cout
-                  << "textgen::units::" + unit_format_item.first + "::format" << "="
-                  << unit_format_item.second << '\n';
-#endif
+      std::size_t end = 0;
+      double coordinate = 0;
+      try
+      {
+        coordinate = std::stod(number, &end);
+      }
+      catch (...)
+      {
+        return value;
+      }
+      if (end != boost::algorithm::trim_right_copy(number).size())
+        return value;
+
+      char buffer[64];
+      snprintf(buffer, sizeof(buffer), "%.*f", decimals, std::round(coordinate / grid) * grid);
+      if (!ret.empty())
+        ret += ',';
+      ret += buffer;
+      ret += suffix;
+    }
+    return ret;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Snap the point coordinates of a request to a grid
+ *
+ * Nearby points then resolve to the same location, whose name is looked
+ * up only once, and share the area id and thus the cached texts. Returns
+ * nothing if the request has no coordinates.
+ */
+// ----------------------------------------------------------------------
+
+std::optional<SmartMet::Spine::HTTP::Request> snap_request_coordinates(
+    const SmartMet::Spine::HTTP::Request& theRequest, double grid)
+{
+  try
+  {
+    std::optional<SmartMet::Spine::HTTP::Request> ret;
+
+    for (const char* param : coordinate_params)
+    {
+      const auto values = theRequest.getParameterList(param);
+      if (values.empty())
+        continue;
+
+      if (!ret)
+        ret = theRequest;
+      ret->removeParameter(param);
+      for (const auto& value : values)
+        ret->addParameter(param, snap_coordinates(value, grid));
+    }
+
+    return ret;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// The cached texts are shared, the response is the only copy
+std::string join_texts(const std::vector<TextPtr>& texts)
+{
+  std::size_t size = 0;
+  for (const auto& text : texts)
+    size += text->text.size();
+
+  std::string ret;
+  ret.reserve(size);
+  for (const auto& text : texts)
+    ret += text->text;
+  return ret;
+}
+
+// The response in the given encoding if all its texts are precompressed
+std::optional<std::string> join_compressed_texts(const std::vector<TextPtr>& texts,
+                                                 ContentEncoding encoding)
+{
+  try
+  {
+    std::vector<const DeflatedText*> parts;
+    parts.reserve(texts.size());
+    for (const auto& text : texts)
+    {
+      if (!text->deflated)
+        return {};
+      parts.push_back(&*text->deflated);
+    }
+    return join_deflated(parts, encoding);
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// Strong validator of the texts of a response, different for each encoding
+std::string make_etag(std::uint64_t hash, ContentEncoding encoding)
+{
+  std::ostringstream out;
+  out << '"' << std::hex << std::setw(16) << std::setfill('0') << hash;
+  if (encoding != ContentEncoding::identity)
+    out << '-' << encoding_name(encoding);
+  out << '"';
+  return out.str();
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Test whether the client already has the current texts
+ *
+ * If-None-Match takes precedence over If-Modified-Since as in RFC 9110.
+ * Weak comparison is used for If-None-Match as allowed for GET requests.
+ */
+// ----------------------------------------------------------------------
+
+bool is_not_modified(const SmartMet::Spine::HTTP::Request& theRequest,
+                     const std::string& etag,
+                     const Fmi::DateTime& modified)
+{
+  try
+  {
+    auto if_none_match = theRequest.getHeader("If-None-Match");
+    if (if_none_match)
+    {
+      std::vector<std::string> tags;
+      boost::algorithm::split(tags, *if_none_match, boost::algorithm::is_any_of(","));
+      for (auto& tag : tags)
+      {
+        boost::algorithm::trim(tag);
+        if (boost::algorithm::starts_with(tag, "W/"))
+          tag.erase(0, 2);
+        if (tag == "*" || tag == etag)
+          return true;
+      }
+      return false;
+    }
+
+    auto if_modified_since = theRequest.getHeader("If-Modified-Since");
+    if (!if_modified_since)
+      return false;
+
+    try
+    {
+      return modified <= Fmi::TimeParser::parse_http(*if_modified_since);
+    }
+    catch (...)
+    {
+      // Invalid dates are ignored
+      return false;
+    }
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Test whether the request is a batch of queries
+ *
+ * Only JSON content is a batch, other POSTs such as HTML forms are
+ * ordinary queries whose parameters are in the content.
+ */
+// ----------------------------------------------------------------------
+
+bool is_batch_request(const SmartMet::Spine::HTTP::Request& theRequest)
+{
+  try
+  {
+    if (theRequest.getMethod() != SmartMet::Spine::HTTP::RequestMethod::POST)
+      return false;
+
+    auto content_type = theRequest.getHeader("Content-Type");
+    if (!content_type)
+      return false;
+
+    std::string media_type = content_type->substr(0, content_type->find(';'));
+    boost::algorithm::trim(media_type);
+    return boost::algorithm::iequals(media_type, "application/json");
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+}  // namespace
+
+bool Plugin::queryIsFast(const SmartMet::Spine::HTTP::Request& /*theRequest*/) const
+{
+  // Uses databases and such
+  // Also, is rarely used interactively
+  return false;
+}
+// ----------------------------------------------------------------------
+/*!
+ * \brief Perform a TextGen query
+ */
+// ----------------------------------------------------------------------
+std::vector<TextPtr> Plugin::query(SmartMet::Spine::Reactor& /*theReactor*/,
+                                   const SmartMet::Spine::HTTP::Request& theRequest,
+                                   SmartMet::Spine::HTTP::Response& theResponse,
+                                   text_status& status)
+{
+  try
+  {
+    // The configuration stays the same for the whole request even if it is reloaded meanwhile
+    const ConfigSnapshotPtr snapshot = itsConfig.snapshot();
+
+    auto forecast_texts =
+        forecastTexts(snapshot, theRequest, itsConfig.getMaxParallelAreas(), status);
+
+    if (status.stale)
+      theResponse.setHeader("X-TextGen-Stale", "true");
+
+    return forecast_texts;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Produce the forecast texts of the areas of a request
+ *
+ * The areas of the request are generated by at most max_workers threads,
+ * the calling thread and helpers from the area pool shared by all requests.
+ * The logs of the helpers are merged into the log of the request. The status tells whether any of
+ * the texts was of the previous querydata, and combines the hashes and
+ * the generation times of the texts for conditional requests.
+ */
+// ----------------------------------------------------------------------
+
+std::vector<TextPtr> Plugin::forecastTexts(const ConfigSnapshotPtr& snapshot,
+                                           const SmartMet::Spine::HTTP::Request& theRequest,
+                                           std::size_t max_workers,
+                                           text_status& status)
+{
+  try
+  {
+    SmartMet::Spine::HTTP::ParamMap queryParameters(theRequest.getParameterMap());
+    std::string errorMessage;
+
+    if (!verifyHttpRequestParameters(*snapshot, queryParameters, errorMessage))
+      throw Fmi::Exception(BCP, errorMessage);
+
+    std::string product_name(mmap_string(queryParameters, PRODUCT_PARAM, DEFAULT_PRODUCT_NAME));
+    const ProductConfig& config = snapshot->getProductConfig(product_name);
+    bool configIsModified = config.isModified(CACHE_EXPIRATION_TIME_SEC);
+
+    // set text generator settings (stored in thread local storage)
+    std::string modified_params;
+    set_textgen_settings(config, queryParameters, modified_params);
+
+    std::string languageParam = mmap_string(queryParameters, LANGUAGE_PARAM);
+
+    // Optionally nearby points share the location and the cached texts
+    std::optional<SmartMet::Spine::HTTP::Request> snapped_request;
+    if (config.coordinateGrid() > 0)
+      snapped_request = snap_request_coordinates(theRequest, config.coordinateGrid());
+
+    const LocationAreasPtr locations =
+        resolveLocations(*snapshot,
+                         snapped_request ? *snapped_request : theRequest,
+                         product_name,
+                         languageParam);
+    const LocationAreas& weatherAreaVector = *locations;
+
+    std::string formatter_name(mmap_string(queryParameters, FORMATTER_PARAM));
+
+    TextGenPosixTime forecasttime;
+    const std::string forecasttime_param = mmap_string(queryParameters, FORECASTTIME_PARAM);
+    if (!parse_forecasttime_parameter(forecasttime_param, forecasttime, errorMessage))
+    {
+      throw Fmi::Exception(BCP, errorMessage);
+    }
+
+    // Without a forecasttime the texts are made for the current time rounded down
+    // to the configured resolution, so that they can be shared by later requests
+    const int resolution = itsConfig.getForecastTimeResolution();
+    const std::time_t request_time = forecasttime.EpochTime();
+    if (forecasttime_param.empty())
+      forecasttime.ChangeBySeconds(
+          static_cast<long>(round_forecasttime(request_time, resolution) - request_time));
+
+    TextGenPosixTime timestamp;
+    const std::string forecasttime_key = Fmi::to_string(forecasttime.EpochTime());
+
+    // Texts are valid until the querydata of the product changes. If the querydata
+    // is not monitored, generate forecast at least every CACHE_EXPIRATION_TIME_SEC secods
+    const data_version version = itsConfig.getDataVersion(config);
+    std::string data_key;
+    if (version.id > 0)
+      data_key = data_version_key(version.id);
+    else
+      data_key = Fmi::to_string(timestamp.EpochTime() / CACHE_EXPIRATION_TIME_SEC);
+
+    // Texts of the previous querydata may be served for a while after it has changed
+    std::string stale_data_key;
+    const int max_stale = itsConfig.getStaleWhileRevalidate();
+    if (max_stale > 0 && version.previous_id > 0 &&
+        timestamp.EpochTime() - version.changed <= max_stale)
+      stale_data_key = data_version_key(version.previous_id);
+
+    // Texts stay fresh until the querydata is expected to be updated
+    status.max_age = itsConfig.getFreshness(version, timestamp.EpochTime());
+    // but a later request without a forecasttime gets texts of a later time
+    if (forecasttime_param.empty())
+      status.max_age =
+          std::min(status.max_age, seconds_until_next_forecasttime(request_time, resolution));
+
+    const WeatherAreas& theMaskContainer = snapshot->getProductMasks(product_name);
+    product_cache_stats& cache_stats = productCacheStats(product_name);
+
+    auto wktParam = queryParameters.find("wkt");
+    if (wktParam != queryParameters.end())
+      modified_params += (";" + wktParam->second);
+
+    // The parts of the keys common to all areas, including the possibly long
+    // modified settings, are hashed only once
+    const std::string key_postgis_part =
+        mmap_string(queryParameters, POSTGIS_PARAM) + ";" + forecasttime_key + ";";
+    const TextKeyPrefix key_prefix(product_name,
+                                   languageParam,
+                                   formatter_name,
+                                   key_postgis_part + data_key + ";" + modified_params);
+    std::optional<TextKeyPrefix> stale_key_prefix;
+    if (!stale_data_key.empty())
+      stale_key_prefix.emplace(product_name,
+                               languageParam,
+                               formatter_name,
+                               key_postgis_part + stale_data_key + ";" + modified_params);
+
+    // Areas are independent of each other, so they are handed out to at most
+    // max_workers threads. The calling thread is one of the workers, the
+    // others are helpers from the area pool.
+    const std::size_t area_count = weatherAreaVector.size();
+    std::vector<TextPtr> area_texts(area_count);
+    std::vector<std::exception_ptr> area_errors(area_count);
+    std::atomic<std::size_t> next_area{0};
+    std::atomic<bool> stale_texts{false};
+
+    auto generate_areas = [&]()
+    {
+      TextGen::TextGenerator generator = make_generator(theMaskContainer);
+      generator.time(forecasttime);
+
+      for (std::size_t i = next_area++; i < area_count; i = next_area++)
+      {
+        try
+        {
+          const auto& area = weatherAreaVector[i].second;
+          const auto& area_id = weatherAreaVector[i].first;
+          const TextKey key = key_prefix.key(area_id, area.isPoint());
+          std::optional<TextKey> stale_key;
+          if (stale_key_prefix)
+            stale_key = stale_key_prefix->key(area_id, area.isPoint());
+
+          bool stale = false;
+          area_texts[i] = areaForecastText(config,
+                                           generator,
+                                           area,
+                                           key,
+                                           stale_key,
+                                           languageParam,
+                                           formatter_name,
+                                           version.current,
+                                           configIsModified,
+                                           cache_stats,
+                                           stale);
+          if (stale)
+          {
+            stale_texts = true;
+            refreshAreaText(snapshot,
+                            product_name,
+                            queryParameters,
+                            forecasttime,
+                            area,
+                            key,
+                            languageParam,
+                            formatter_name,
+                            version.current);
+          }
+        }
+        catch (...)
+        {
+          area_errors[i] = std::current_exception();
+        }
+      }
+    };
+
+    const std::size_t worker_count =
+        std::max<std::size_t>(1, std::min<std::size_t>(max_workers, area_count));
+
+    // Helpers come from the pool shared by all requests. If the pool is busy
+    // the request generates the remaining areas itself.
+    auto helpers = std::make_shared<area_helpers>();
+    std::exception_ptr request_error;
+    {
+      area_helpers_guard guard(helpers);
+      for (std::size_t i = 1; i < worker_count; i++)
+      {
+        const bool submitted = itsAreaPool->submit(
+            [helpers, &generate_areas, &config, &queryParameters]()
+            {
+              if (!helpers->start())
+                return;
+
+              // The log of the pool thread is merged into the log of the request
+              MessageLogger::open();
+              std::exception_ptr error;
+              try
+              {
+                // Settings are thread local, the pool threads keep them for later requests
+                std::string ignored_params;
+                set_textgen_settings(config, queryParameters, ignored_params);
+                generate_areas();
+              }
+              catch (...)
+              {
+                error = std::current_exception();
+              }
+              helpers->finish(MessageLogger::str(), error);
+            });
+        if (!submitted)
+          break;
+      }
+
+      try
+      {
+        generate_areas();
+      }
+      catch (...)
+      {
+        request_error = std::current_exception();
+      }
     }
 
-    // output document
-    for (unsigned int i = 0; i < config.numberOfOutputDocumentConfigs(); i++)
+    if (!helpers->logs.empty())
     {
-      const auto& output_document_config_item = config.getOutputDocumentConfig(i);
-      std::string setting_string = get_setting_string(output_document_config_item.first,
-                                                      output_document_config_item.second,
-                                                      params,
-                                                      modified_params);
-      Settings::set(output_document_config_item.first, setting_string);
-#ifdef MYDEBUG
-      if (i == 0)
-        std::cout << "\nOutput document:\n";
-      std::cout << output_document_config_item.first << "=" << output_document_config_item.second
-                << '\n';
-#endif
+      MessageLogger log("Textgen::area_helpers");
+      for (const auto& helper_log : helpers->logs)
+        log << helper_log;
     }
 
-    // area parameters
-    for (unsigned int i = 0; i < config.numberOfAreaConfigs(); i++)
-    {
-      const auto& area_config_item = config.getAreaConfig(i);
-      Settings::set(area_config_item.first, area_config_item.second);
-#ifdef MYDEBUG
-      if (i == 0)
-        std::cout << "\nAreas:\n";
-      std::cout << area_config_item.first << "=" << area_config_item.second << '\n';
-#endif
-    }
+    if (request_error)
+      std::rethrow_exception(request_error);
+    if (helpers->error)
+      std::rethrow_exception(helpers->error);
 
-    // forestfirewarnig parameters
-    Settings::set("qdtext::forestfirewarning::directory", config.forestfirewarning_directory());
-    for (unsigned int i = 0; i < config.numberOfFireWarningAreaCodes(); i++)
+    for (std::size_t i = 0; i < area_count; i++)
     {
-      const auto& area_code_config_item = config.getFireWarningAreaCode(i);
-      Settings::set(area_code_config_item.first, area_code_config_item.second);
-#ifdef MYDEBUG
-      if (i == 0)
-        std::cout << "\nArea codes:\n";
-      std::cout << area_code_config_item.first << "=" << area_code_config_item.second << '\n';
-#endif
+      if (area_errors[i])
+        std::rethrow_exception(area_errors[i]);
+      status.hash = stable_hash_combine(status.hash, area_texts[i]->hash);
+      status.generated = std::max(status.generated, area_texts[i]->generated);
     }
+
+    status.stale = stale_texts;
+    // Stale texts are replaced soon
+    if (status.stale)
+      status.max_age = std::min(status.max_age, itsConfig.getMinFreshness());
+
+    return area_texts;
   }
   catch (...)
   {
@@ -394,35 +1136,183 @@ void set_textgen_settings(const ProductConfig& config,
   }
 }
 
-void handle_exception(const SmartMet::Spine::HTTP::Request& theRequest,
-                      SmartMet::Spine::HTTP::Response& theResponse,
-                      const std::string& what,
-                      const std::string& log,
-                      SmartMet::Spine::HTTP::Status debugStatus,
-                      bool isdebug)
+// ----------------------------------------------------------------------
+/*!
+ * \brief Perform a batch of TextGen queries
+ *
+ * The content is a JSON array of jobs, each job an object of request
+ * parameters. Parameters of the URL apply to all jobs unless a job
+ * overrides them. The result is a JSON array with the text or the error
+ * of each job in the same order. Jobs of the same product are run
+ * consecutively by the same thread so that its settings are reused, and
+ * overlapping texts are generated only once thanks to the caches.
+ */
+// ----------------------------------------------------------------------
+
+std::string Plugin::batchQuery(const SmartMet::Spine::HTTP::Request& theRequest)
 {
   try
   {
-    std::cerr << Spine::log_time_str() << " error: " << what << '\n'
-              << "Query: " << theRequest.getURI() << '\n'
-              << "ClientIP: " << theRequest.getClientIP() << '\n';
+    const ConfigSnapshotPtr snapshot = itsConfig.snapshot();
+
+    Json::Value jobs;
+    std::string errors;
+    Json::CharReaderBuilder reader_builder;
+    std::unique_ptr<Json::CharReader> reader(reader_builder.newCharReader());
+    const std::string& content = theRequest.getContent();
+    if (!reader->parse(content.data(), content.data() + content.size(), &jobs, &errors))
+      throw Fmi::Exception(BCP, "Failed to parse batch request: " + errors);
+
+    if (!jobs.isArray())
+      throw Fmi::Exception(BCP, "Batch request must be a JSON array of jobs");
+
+    const std::size_t job_count = jobs.size();
+    if (job_count > itsConfig.getMaxBatchJobs())
+      throw Fmi::Exception(BCP,
+                           "Too many jobs in batch request, the maximum is " +
+                               Fmi::to_string(itsConfig.getMaxBatchJobs()));
+
+    // Jobs are ordinary requests
+    std::vector<SmartMet::Spine::HTTP::Request> requests(job_count);
+    std::vector<std::string> job_errors(job_count);
+    for (Json::ArrayIndex i = 0; i < job_count; i++)
+    {
+      for (const auto& param : theRequest.getParameterMap())
+        requests[i].setParameter(param.first, param.second);
 
-    if (isdebug)
+      const Json::Value& job = jobs[i];
+      if (!job.isObject())
+      {
+        job_errors[i] = "Job must be a JSON object of request parameters";
+        continue;
+      }
+      for (const auto& name : job.getMemberNames())
+      {
+        const Json::Value& value = job[name];
+        if (name == BATCH_JOB_ID || value.isNull())
+          continue;
+        if (value.isArray() || value.isObject())
+          job_errors[i] = "Value of parameter '" + name + "' must be a scalar";
+        else
+          requests[i].setParameter(name, value.asString());
+      }
+    }
+
+    std::vector<std::size_t> order(job_count);
+    for (std::size_t i = 0; i < job_count; i++)
+      order[i] = i;
+    std::stable_sort(order.begin(),
+                     order.end(),
+                     [&requests](std::size_t a, std::size_t b)
+                     {
+                       return requests[a].getParameter(PRODUCT_PARAM).value_or("") <
+                              requests[b].getParameter(PRODUCT_PARAM).value_or("");
+                     });
+
+    std::vector<std::string> job_texts(job_count);
+    std::vector<char> job_stale(job_count, 0);
+    std::atomic<std::size_t> next_job{0};
+
+    auto run_jobs = [&]()
     {
-      std::string msg = "Error: " + what;
-      theResponse.setContent(msg + "\n\n" + log);
-      theResponse.setStatus(debugStatus);
+      for (std::size_t n = next_job++; n < job_count; n = next_job++)
+      {
+        const std::size_t i = order[n];
+        if (!job_errors[i].empty())
+          continue;
+        try
+        {
+          text_status status;
+          job_texts[i] = join_texts(forecastTexts(snapshot, requests[i], 1, status));
+          job_stale[i] = status.stale;
+        }
+        catch (...)
+        {
+          Fmi::Exception exception(BCP, "Operation failed!", nullptr);
+          job_errors[i] = exception.what();
+        }
+      }
+    };
+
+    // Jobs are handed out to at most max_parallel_jobs threads. The calling
+    // thread is one of them, the others are helpers from the area pool shared
+    // by all requests. If the pool is busy the request runs the jobs itself.
+    const std::size_t worker_count = std::max<std::size_t>(
+        1, std::min<std::size_t>(itsConfig.getMaxParallelJobs(), job_count));
+
+    auto helpers = std::make_shared<area_helpers>();
+    std::exception_ptr request_error;
+    {
+      area_helpers_guard guard(helpers);
+      for (std::size_t i = 1; i < worker_count; i++)
+      {
+        const bool submitted = itsAreaPool->submit(
+            [helpers, &run_jobs]()
+            {
+              if (!helpers->start())
+                return;
+
+              // The log of the pool thread is merged into the log of the request
+              MessageLogger::open();
+              std::exception_ptr error;
+              try
+              {
+                run_jobs();
+              }
+              catch (...)
+              {
+                error = std::current_exception();
+              }
+              helpers->finish(MessageLogger::str(), error);
+            });
+        if (!submitted)
+          break;
+      }
+
+      try
+      {
+        run_jobs();
+      }
+      catch (...)
+      {
+        request_error = std::current_exception();
+      }
     }
-    else
+
+    if (!helpers->logs.empty())
     {
-      theResponse.setStatus(SmartMet::Spine::HTTP::Status::internal_server_error);
+      MessageLogger log("Textgen::batch_helpers");
+      for (const auto& helper_log : helpers->logs)
+        log << helper_log;
     }
 
-    // Remove newlines, make sure length is reasonable
-    std::string msg = what;
-    boost::algorithm::replace_all(msg, "\n", " ");
-    msg = msg.substr(0, 100);
-    theResponse.setHeader("X-TextGen-Error", msg);
+    if (request_error)
+      std::rethrow_exception(request_error);
+    if (helpers->error)
+      std::rethrow_exception(helpers->error);
+
+    Json::Value results(Json::arrayValue);
+    for (Json::ArrayIndex i = 0; i < job_count; i++)
+    {
+      Json::Value result(Json::objectValue);
+      if (jobs[i].isObject() && jobs[i].isMember(BATCH_JOB_ID))
+        result[BATCH_JOB_ID] = jobs[i][BATCH_JOB_ID];
+      if (job_errors[i].empty())
+      {
+        result["text"] = job_texts[i];
+        if (job_stale[i] != 0)
+          result["stale"] = true;
+      }
+      else
+      {
+        result["error"] = job_errors[i];
+      }
+      results.append(result);
+    }
+
+    Json::StreamWriterBuilder writer_builder;
+    writer_builder["indentation"] = "";
+    return Json::writeString(writer_builder, results);
   }
   catch (...)
   {
@@ -430,135 +1320,223 @@ void handle_exception(const SmartMet::Spine::HTTP::Request& theRequest,
   }
 }
 
-}  // namespace
-
-bool Plugin::queryIsFast(const SmartMet::Spine::HTTP::Request& /*theRequest*/) const
-{
-  // Uses databases and such
-  // Also, is rarely used interactively
-  return false;
-}
 // ----------------------------------------------------------------------
 /*!
- * \brief Perform a TextGen query
+ * \brief Fetch the forecast text of one area from the cache or generate it
+ *
+ * Textgen settings of the product must already be set in the calling thread.
+ * If the text of the current querydata is not cached but the text of the
+ * previous querydata is, the latter is returned and stale is set.
  */
 // ----------------------------------------------------------------------
-std::string Plugin::query(SmartMet::Spine::Reactor& /*theReactor*/,
-                          const SmartMet::Spine::HTTP::Request& theRequest,
-                          SmartMet::Spine::HTTP::Response& /* theResponse */)
+
+TextPtr Plugin::areaForecastText(const ProductConfig& config,
+                                 TextGen::TextGenerator& generator,
+                                 const TextGen::WeatherArea& area,
+                                 const TextKey& key,
+                                 const std::optional<TextKey>& stale_key,
+                                 const std::string& language,
+                                 const std::string& formatter_name,
+                                 std::time_t data_version,
+                                 bool configIsModified,
+                                 product_cache_stats& cache_stats,
+                                 bool& stale)
 {
   try
   {
-    // area_id,  WeatherArea pair
-    std::vector<std::pair<std::string, TextGen::WeatherArea>> weatherAreaVector;
-    SmartMet::Spine::HTTP::ParamMap queryParameters(theRequest.getParameterMap());
-    std::string errorMessage;
-
-    if (!verifyHttpRequestParameters(queryParameters, errorMessage))
-      throw Fmi::Exception(BCP, errorMessage);
-
-    SmartMet::Spine::ReadLock lock(itsConfig.itsConfigUpdateMutex);
+    // set timezone for the area (stored in thread local storage)
+    TextGenPosixTime::SetThreadTimeZone(config.getAreaTimeZone(area.name()));
 
-    std::string product_name(mmap_string(queryParameters, PRODUCT_PARAM, DEFAULT_PRODUCT_NAME));
-    const ProductConfig& config = itsConfig.getProductConfig(product_name);
-    bool configIsModified = config.isModified(CACHE_EXPIRATION_TIME_SEC);
+    if (!configIsModified)
+    {
+      auto cache_result = itsForecastTextCache.find(key);
 
-    // set text generator settings (stored in thread local storage)
-    std::string modified_params;
-    set_textgen_settings(config, queryParameters, modified_params);
+      if (cache_result)
+      {
+#ifdef MYDEBUG
+        std::cout << "Fetching forecast from cache " << key.str() << '\n';
+#endif
+        ++cache_stats.hits;
+        return cache_result;
+      }
 
-    std::string languageParam = mmap_string(queryParameters, LANGUAGE_PARAM);
+      if (itsDiskCache)
+      {
+        const auto start_time = std::chrono::steady_clock::now();
+        auto disk_result = itsDiskCache->find(key.str());
+        if (disk_result)
+        {
+          const std::chrono::duration<double> cost = std::chrono::steady_clock::now() - start_time;
+          // The generation time is not persisted, the querydata time is the best estimate
+          auto text =
+              make_text(std::move(*disk_result), data_version, itsConfig.getPrecompress());
+          itsForecastTextCache.insert(key, text, cost.count());
+          ++cache_stats.hits;
+          return text;
+        }
+      }
 
-    if (!parse_location_parameters(
-            theRequest, itsConfig, *itsGeoEngine, languageParam, weatherAreaVector, errorMessage))
-    {
-      throw Fmi::Exception(BCP, errorMessage);
+      if (stale_key)
+      {
+        auto stale_result = itsForecastTextCache.find(*stale_key);
+        if (stale_result)
+        {
+          stale = true;
+          ++cache_stats.hits;
+          return stale_result;
+        }
+      }
     }
 
-    std::string formatter_name(mmap_string(queryParameters, FORMATTER_PARAM));
+    ++cache_stats.misses;
+    return generateAreaText(
+        generator, area, key, language, formatter_name, data_version, configIsModified);
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
 
-    TextGenPosixTime forecasttime;
-    if (!parse_forecasttime_parameter(
-            mmap_string(queryParameters, FORECASTTIME_PARAM), forecasttime, errorMessage))
-    {
-      throw Fmi::Exception(BCP, errorMessage);
-    }
-    TextGenPosixTime timestamp;
-    std::stringstream timestamp_cachekey_ss;
-    // generate forecast at least every CACHE_EXPIRATION_TIME_SEC secods
-    timestamp_cachekey_ss << (forecasttime.EpochTime() / CACHE_EXPIRATION_TIME_SEC);
-    timestamp_cachekey_ss << ";" << (timestamp.EpochTime() / CACHE_EXPIRATION_TIME_SEC);
+// ----------------------------------------------------------------------
+/*!
+ * \brief Generate and format the text of one area and cache the results
+ */
+// ----------------------------------------------------------------------
 
-    std::string cache_key_common_part(
-        mmap_string(queryParameters, PRODUCT_PARAM) + ";" + languageParam + ";" + formatter_name +
-        ";" + mmap_string(queryParameters, POSTGIS_PARAM) + ";" + timestamp_cachekey_ss.str());
+TextPtr Plugin::generateAreaText(TextGen::TextGenerator& generator,
+                                 const TextGen::WeatherArea& area,
+                                 const TextKey& key,
+                                 const std::string& language,
+                                 const std::string& formatter_name,
+                                 std::time_t data_version,
+                                 bool configIsModified)
+{
+  try
+  {
+    // Concurrent misses of the same key are served by the first one
+    return itsForecastTextInFlight.run(
+        key,
+        [&]()
+        {
+          const std::string document_key = key.documentKey();
 
-    const WeatherAreas& theMaskContainer = itsConfig.getProductMasks(product_name);
+          // Generation time is the cost of evicting the text from the cache
+          const auto start_time = std::chrono::steady_clock::now();
 
-    bool masksExists(theMaskContainer.find(LAND_MASK_NAME) != theMaskContainer.end() &&
-                     theMaskContainer.find(COAST_MASK_NAME) != theMaskContainer.end());
+          // One generated document serves all languages and formatters
+          std::shared_ptr<const TextGen::Document> document;
+          auto document_result = itsDocumentCache.find(document_key);
 
-    TextGen::TextGenerator generator(
-        masksExists ? TextGen::TextGenerator(theMaskContainer.at(LAND_MASK_NAME),
-                                             theMaskContainer.at(COAST_MASK_NAME))
-                    : TextGen::TextGenerator());
+          if (!configIsModified && document_result)
+          {
+#ifdef MYDEBUG
+            std::cout << "Fetching document from cache " << document_key << '\n';
+#endif
+            document = document_result->document;
+          }
+          else
+          {
+#ifdef MYDEBUG
+            std::cout << "Generating new forecast" << '\n';
+#endif
+            document = std::make_shared<const TextGen::Document>(generator.generate(area));
 
-    std::string forecast_text;
+            document_item di;
+            di.document = document;
+            itsDocumentCache.insert(document_key, di);
+          }
 
-    auto wktParam = queryParameters.find("wkt");
-    if (wktParam != queryParameters.end())
-      modified_params += (";" + wktParam->second);
+          // create formatter
+          std::shared_ptr<TextGen::TextFormatter> formatter(
+              TextGen::TextFormatterFactory::create(formatter_name));
+          formatter->dictionary(getDictionary(language));
 
-    for (const auto& item : weatherAreaVector)
-    {
-      const auto& area = item.second;
-      const auto& area_id = item.first;
-      std::string forecast_text_area;
-      const auto& area_name = area.name();
-      std::string cache_key = cache_key_common_part + ";" + area_id + ";" +
-                              Fmi::to_string(area.isPoint()) + ";" + modified_params;
+          // Compressed once here instead of for every response
+          auto forecast_text_area = make_text(
+              formatter->format(*document), std::time(nullptr), itsConfig.getPrecompress());
 
-      // set timezone for the area (stored in thread local storage)
-      TextGenPosixTime::SetThreadTimeZone(config.getAreaTimeZone(area_name));
+          const std::chrono::duration<double> cost = std::chrono::steady_clock::now() - start_time;
+          itsForecastTextCache.insert(key, forecast_text_area, cost.count());
 
-      auto cache_result = itsForecastTextCache.find(cache_key);
+          // Texts of unmonitored querydata expire by time and are not worth persisting
+          if (itsDiskCache && data_version > 0)
+            itsDiskCache->insert(key.str(), forecast_text_area->text, data_version);
 
-      if (!configIsModified && cache_result)
-      {
-#ifdef MYDEBUG
-        std::cout << "Fetching forecast from cache " << cache_key << '\n';
-#endif
-        forecast_text_area = cache_result->member;
-      }
-      else
-      {
-        // create formatter
-        std::shared_ptr<TextGen::TextFormatter> formatter(
-            TextGen::TextFormatterFactory::create(formatter_name));
-        formatter->dictionary(itsDictionary);
+          return forecast_text_area;
+        });
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
 
-#ifdef MYDEBUG
-        std::cout << "Generating new forecast" << '\n';
-#endif
+// ----------------------------------------------------------------------
+/*!
+ * \brief Regenerate a text served stale in the background
+ *
+ * Everything the task needs is copied, since the request which served the
+ * stale text does not wait for the task to finish. The snapshot keeps the
+ * product configuration and masks alive. A text already queued is not
+ * queued again, and if the refresh pool is full the regeneration is dropped;
+ * the text stays stale and a later request queues it again.
+ */
+// ----------------------------------------------------------------------
 
-        generator.time(forecasttime);
+void Plugin::refreshAreaText(const ConfigSnapshotPtr& snapshot,
+                             const std::string& product_name,
+                             const SmartMet::Spine::HTTP::ParamMap& parameters,
+                             const TextGenPosixTime& forecasttime,
+                             const TextGen::WeatherArea& area,
+                             const TextKey& key,
+                             const std::string& language,
+                             const std::string& formatter_name,
+                             std::time_t data_version)
+{
+  try
+  {
+    std::lock_guard<std::mutex> lock(itsRefreshMutex);
 
-        const TextGen::Document document = generator.generate(area);
+    // Already being regenerated
+    if (!itsRefreshKeys.insert(key).second)
+      return;
 
+    const bool submitted = itsRefreshPool->submit(
+        [this,
+         snapshot,
+         product_name,
+         parameters,
+         forecasttime,
+         area,
+         key,
+         language,
+         formatter_name,
+         data_version]()
         {
-          SmartMet::Spine::WriteLock lock(gDictionaryMutex);
-          itsDictionary->changeLanguage(languageParam);
-          forecast_text_area = formatter->format(document);
-        }
+          try
+          {
+            const ProductConfig& config = snapshot->getProductConfig(product_name);
+            std::string ignored_params;
+            set_textgen_settings(config, parameters, ignored_params);
+            TextGenPosixTime::SetThreadTimeZone(config.getAreaTimeZone(area.name()));
+
+            TextGen::TextGenerator generator =
+                make_generator(snapshot->getProductMasks(product_name));
+            generator.time(forecasttime);
+            generateAreaText(generator, area, key, language, formatter_name, data_version, false);
+          }
+          catch (...)
+          {
+            Fmi::Exception::Trace(BCP, "Background regeneration failed").printError();
+          }
 
-        cache_item ci;
-        ci.member = forecast_text_area;
-        itsForecastTextCache.insert(cache_key, ci);
-      }
-      forecast_text += forecast_text_area;
-    }
+          std::lock_guard<std::mutex> lock(itsRefreshMutex);
+          itsRefreshKeys.erase(key);
+        });
 
-    return forecast_text;
+    if (!submitted)
+      itsRefreshKeys.erase(key);
   }
   catch (...)
   {
@@ -585,9 +1563,6 @@ void Plugin::requestHandler(SmartMet::Spine::Reactor& theReactor,
     const bool isdebug = SmartMet::Spine::optional_bool(theRequest.getParameter("debug"), false);
     const bool print_log = Spine::optional_bool(theRequest.getParameter("printlog"), false);
 
-    // Default expiration time
-    const int expires_seconds = CACHE_EXPIRATION_TIME_SEC;
-
     // Now
     auto t_now = Fmi::SecondClock::universal_time();
 
@@ -595,37 +1570,85 @@ void Plugin::requestHandler(SmartMet::Spine::Reactor& theReactor,
     {
       theResponse.setHeader("Access-Control-Allow-Origin", "*");
 
-      std::string response = query(theReactor, theRequest, theResponse);
-      theResponse.setStatus(SmartMet::Spine::HTTP::Status::ok);
-      if (!isdebug)
-        theResponse.setContent(response);
+      if (is_batch_request(theRequest))
+      {
+        std::string response = batchQuery(theRequest);
+        theResponse.setStatus(SmartMet::Spine::HTTP::Status::ok);
+        theResponse.setContent(std::move(response));
+        theResponse.setHeader("Content-Type", "application/json; charset=UTF-8");
+        theResponse.setHeader("Cache-Control", "no-cache");
+      }
       else
-        theResponse.setContent(response + "\n<pre>" + MessageLogger::str() + "</pre>");
+      {
+        text_status status;
+        const std::vector<TextPtr> texts = query(theReactor, theRequest, theResponse, status);
+        theResponse.setStatus(SmartMet::Spine::HTTP::Status::ok);
+
+        if (std::all_of(texts.begin(),
+                        texts.end(),
+                        [](const TextPtr& text) { return text->text.empty(); }))
+        {
+          std::cerr << "Warning: Empty input for request " << theRequest.getQueryString()
+                    << " from " << theRequest.getClientIP() << '\n';
+        }
 
-      // Build cache expiration time info
-      auto t_expires = t_now + Fmi::Seconds(expires_seconds);
+#ifdef MYDEBUG
+        std::cout << "Output:\n" << join_texts(texts) << '\n';
+#endif
 
-      // The headers themselves
-      std::shared_ptr<Fmi::TimeFormatter> tformat(Fmi::TimeFormatter::create("http"));
+        // Precompressed texts are only joined, nothing is compressed per request
+        ContentEncoding encoding = ContentEncoding::identity;
+        std::optional<std::string> compressed;
+        if (!isdebug && itsConfig.getPrecompress())
+        {
+          theResponse.setHeader("Vary", "Accept-Encoding");
+          encoding = negotiate_encoding(theRequest.getHeader("Accept-Encoding"));
+          if (encoding != ContentEncoding::identity)
+            compressed = join_compressed_texts(texts, encoding);
+          if (!compressed)
+            encoding = ContentEncoding::identity;
+        }
+        std::string response = (compressed ? std::move(*compressed) : join_texts(texts));
 
-      std::string cachecontrol = "public, max-age=" + Fmi::to_string(expires_seconds);
-      std::string expiration = tformat->format(t_expires);
-      std::string modification = tformat->format(t_now);
+        // Build cache expiration time info
+        const int expires_seconds = status.max_age;
+        auto t_expires = t_now + Fmi::Seconds(expires_seconds);
 
-      theResponse.setHeader("Content-Type", "text/html; charset=UTF-8");
-      theResponse.setHeader("Cache-Control", cachecontrol);
-      theResponse.setHeader("Expires", expiration);
-      theResponse.setHeader("Last-Modified", modification);
+        // The headers themselves
+        std::shared_ptr<Fmi::TimeFormatter> tformat(Fmi::TimeFormatter::create("http"));
 
-      if (response.empty())
-      {
-        std::cerr << "Warning: Empty input for request " << theRequest.getQueryString() << " from "
-                  << theRequest.getClientIP() << '\n';
-      }
+        std::string cachecontrol = "public, max-age=" + Fmi::to_string(expires_seconds);
+        std::string expiration = tformat->format(t_expires);
 
-#ifdef MYDEBUG
-      std::cout << "Output:\n" << response << '\n';
-#endif
+        theResponse.setHeader("Content-Type", "text/html; charset=UTF-8");
+        theResponse.setHeader("Cache-Control", cachecontrol);
+        theResponse.setHeader("Expires", expiration);
+
+        if (isdebug)
+        {
+          // The log differs from request to request
+          response += "\n<pre>" + MessageLogger::str() + "</pre>";
+          theResponse.setHeader("Last-Modified", tformat->format(t_now));
+          theResponse.setContent(std::move(response));
+        }
+        else
+        {
+          const auto t_modified =
+              (status.generated > 0 ? Fmi::DateTime::from_time_t(status.generated) : t_now);
+          const std::string etag = make_etag(status.hash, encoding);
+          theResponse.setHeader("ETag", etag);
+          theResponse.setHeader("Last-Modified", tformat->format(t_modified));
+
+          if (is_not_modified(theRequest, etag, t_modified))
+            theResponse.setStatus(SmartMet::Spine::HTTP::Status::not_modified);
+          else
+          {
+            if (encoding != ContentEncoding::identity)
+              theResponse.setHeader("Content-Encoding", encoding_name(encoding));
+            theResponse.setContent(std::move(response));
+          }
+        }
+      }
     }
     catch (...)
     {
@@ -641,11 +1664,12 @@ void Plugin::requestHandler(SmartMet::Spine::Reactor& theReactor,
     if (print_log)
       std::cout << MessageLogger::str() << '\n';
 
-    // delete textgen settings of current thread
-    Settings::release();
+    // Server threads are shared with other plugins, only pool threads keep settings
+    release_textgen_settings();
   }
   catch (...)
   {
+    release_textgen_settings();
     throw Fmi::Exception::Trace(BCP, "Operation failed!");
   }
 }
@@ -694,21 +1718,35 @@ void Plugin::init()
     itsConfig.init(itsGisEngine.get());
 
     // Init caches
-    itsForecastTextCache.resize(boost::numeric_cast<size_t>(itsConfig.getForecastTextCacheSize()));
+    itsForecastTextCache.resize(itsConfig.getForecastTextCacheBytes());
+    itsDocumentCache.resize(boost::numeric_cast<size_t>(itsConfig.getDocumentCacheSize()));
+    itsWktAreaCache.resize(boost::numeric_cast<size_t>(itsConfig.getWktCacheSize()));
+    itsLocationCache.resize(boost::numeric_cast<size_t>(itsConfig.getLocationCacheSize()));
+
+    // Queued helpers are not needed if the pool is busy, the requests generate
+    // their areas themselves
+    itsAreaPool = std::make_unique<WorkerPool>(
+        "textgen-area", itsConfig.getAreaThreads(), itsConfig.getAreaThreads());
+    itsRefreshPool = std::make_unique<WorkerPool>(
+        "textgen-refresh", itsConfig.getRefreshThreads(), itsConfig.getRefreshQueueSize());
+
+    if (!itsConfig.getDiskCacheDirectory().empty())
+    {
+      itsDiskCache = std::make_unique<DiskCache>(itsConfig.getDiskCacheDirectory(),
+                                                 itsConfig.getDiskCacheSize());
+      // Texts of querydata which has changed since they were stored are not loaded
+      itsDiskCache->load([this](const std::string& key, std::time_t stamp)
+                         { return is_current_text(itsConfig, key, stamp); });
+    }
 
-    /* Initialize dictionary */
+    /* Initialize dictionaries, one instance per language */
     const auto& dictionary_name = itsConfig.dictionary();
-    if (dictionary_name == "multimysqlplusgeonames")
-      itsDictionary = std::make_shared<DatabaseDictionariesPlusGeonames>("mysql");
-    else if (dictionary_name == "multipostgresqlplusgeonames")
-      itsDictionary = std::make_shared<DatabaseDictionariesPlusGeonames>("postgresql");
-    else if (dictionary_name == "multifileplusgeonames")
-      itsDictionary = std::make_shared<FileDictionariesPlusGeonames>();
-    else if (dictionary_name == "multipoplusgeonames")
-      itsDictionary = std::make_shared<PoDictionariesPlusGeonames>();
-    else
-      itsDictionary = static_cast<std::shared_ptr<TextGen::Dictionary>>(
-          (TextGen::DictionaryFactory::create(dictionary_name)));
+    for (const auto& lang : itsConfig.supportedLanguages())
+      itsDictionaries[lang] = create_dictionary(dictionary_name);
+
+    if (itsDictionaries.empty())
+      throw Fmi::Exception(BCP, "No supported languages configured for textgen plugin");
+
     // Fall back to the path where smartmet-library-textgen installs its .po
     // files so that unconfigured deployments — including the integration tests
     // — pick up the library's dictionaries automatically.
@@ -718,7 +1756,7 @@ void Plugin::init()
     Settings::set("textgen::filedictionaries", dictionaries);
     Settings::set("textgen::podictionaries", dictionaries);
 
-    const std::string dictionaryId = itsDictionary->getDictionaryId();
+    const std::string dictionaryId = itsDictionaries.begin()->second->getDictionaryId();
     if (dictionaryId == "mysql" || dictionaryId == "postgresql")
     {
       const db_connect_info& dci = itsConfig.getDatabaseConnectInfo(dictionaryId);
@@ -749,11 +1787,15 @@ void Plugin::init()
 #endif
     }
 
-    itsDictionary->geoinit(itsGeoEngine.get());
-
-    // Read all languages at init
-    for (const auto& lang : itsConfig.supportedLanguages())
-      itsDictionary->init(lang);
+    // Read all languages at init. The language of an instance never changes
+    // after this, so formatters may share the instances without locking.
+    for (const auto& lang_dictionary : itsDictionaries)
+    {
+      const auto& dictionary = lang_dictionary.second;
+      dictionary->geoinit(itsGeoEngine.get());
+      dictionary->init(lang_dictionary.first);
+      dictionary->changeLanguage(lang_dictionary.first);
+    }
 
     if (!itsReactor->addContentHandler(this,
                                        itsConfig.defaultUrl(),
@@ -776,6 +1818,12 @@ void Plugin::shutdown()
 {
   std::cout << "  -- Shutdown requested (textgenplugin)\n";
   itsConfig.shutdown();
+  if (itsDiskCache)
+    itsDiskCache->shutdown();
+  if (itsAreaPool)
+    itsAreaPool->shutdown();
+  if (itsRefreshPool)
+    itsRefreshPool->shutdown();
 }
 
 // ----------------------------------------------------------------------
@@ -802,20 +1850,94 @@ int Plugin::getRequiredAPIVersion() const
 
 // check that minimum number of parameters are defined and set default values
 
-bool Plugin::verifyHttpRequestParameters(SmartMet::Spine::HTTP::ParamMap& queryParameters,
+// ----------------------------------------------------------------------
+/*!
+ * \brief Resolve the locations of a request into areas
+ *
+ * The same locations are requested over and over again, so the results
+ * are cached by the request parameters which may affect them. Cached
+ * results are discarded when the geometries are reloaded, which happens
+ * whenever a product configuration changes.
+ */
+// ----------------------------------------------------------------------
+
+LocationAreasPtr Plugin::resolveLocations(const ConfigSnapshot& snapshot,
+                                          const SmartMet::Spine::HTTP::Request& theRequest,
+                                          const std::string& product_name,
+                                          const std::string& language)
+{
+  try
+  {
+    const std::size_t generation = snapshot.geometryGeneration();
+    std::size_t cached_generation = itsLocationCacheGeneration;
+    if (generation > cached_generation &&
+        itsLocationCacheGeneration.compare_exchange_strong(cached_generation, generation))
+      itsLocationCache.clear();
+
+    // Only the location parameters, so that for example requests of different
+    // forecast times or dictionary settings share the result
+    std::string key = Fmi::to_string(generation) + '\n' + language;
+
+    // Points resolve differently in products with configured point areas
+    const AreaIndex* point_areas = snapshot.getPointAreaIndex(product_name);
+    if (point_areas)
+      key += '\n' + product_name;
+
+    const auto& params = theRequest.getParameterMap();
+    for (const char* name : location_params)
+    {
+      const auto range = params.equal_range(name);
+      for (auto it = range.first; it != range.second; ++it)
+      {
+        key += '\n';
+        key += it->first;
+        key += '=';
+        key += it->second;
+      }
+    }
+
+    auto cached = itsLocationCache.find(key);
+    if (cached)
+      return *cached;
+
+    auto locations = std::make_shared<LocationAreas>();
+    std::string errorMessage;
+    if (!parse_location_parameters(theRequest,
+                                   snapshot,
+                                   *itsGeoEngine,
+                                   language,
+                                   point_areas,
+                                   itsWktAreaCache,
+                                   *locations,
+                                   errorMessage))
+    {
+      throw Fmi::Exception(BCP, errorMessage);
+    }
+
+    itsLocationCache.insert(key, locations);
+    return locations;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+bool Plugin::verifyHttpRequestParameters(const ConfigSnapshot& snapshot,
+                                         SmartMet::Spine::HTTP::ParamMap& queryParameters,
                                          std::string& errorMessage)
 {
   try
   {
     std::string product_name(mmap_string(queryParameters, PRODUCT_PARAM, DEFAULT_PRODUCT_NAME));
 
-    if (!itsConfig.productConfigExists(product_name))
+    if (!snapshot.productConfigExists(product_name))
     {
       errorMessage = "Configuration missing for product '" + product_name + "'";
       return false;
     }
 
-    const ProductConfig& config(itsConfig.getProductConfig(product_name));
+    const ProductConfig& config(snapshot.getProductConfig(product_name));
 
     // set default values
     if (queryParameters.find(LANGUAGE_PARAM) == queryParameters.end())
@@ -824,6 +1946,26 @@ bool Plugin::verifyHttpRequestParameters(SmartMet::Spine::HTTP::ParamMap& queryP
     if (queryParameters.find(FORMATTER_PARAM) == queryParameters.end())
       queryParameters.insert(make_pair(FORMATTER_PARAM, config.formatter()));
 
+    std::string language(mmap_string(queryParameters, LANGUAGE_PARAM));
+    if (itsDictionaries.find(language) == itsDictionaries.end())
+    {
+      errorMessage = "Language '" + language + "' is not supported";
+      return false;
+    }
+
+    // Unknown formatters must be rejected before their names are interned into cache keys
+    std::string formatter_name(mmap_string(queryParameters, FORMATTER_PARAM));
+    try
+    {
+      std::unique_ptr<TextGen::TextFormatter> formatter(
+          TextGen::TextFormatterFactory::create(formatter_name));
+    }
+    catch (...)
+    {
+      errorMessage = "Formatter '" + formatter_name + "' is not supported";
+      return false;
+    }
+
     return true;
   }
   catch (...)
@@ -832,11 +1974,56 @@ bool Plugin::verifyHttpRequestParameters(SmartMet::Spine::HTTP::ParamMap& queryP
   }
 }
 
+const std::shared_ptr<TextGen::Dictionary>& Plugin::getDictionary(const std::string& language) const
+{
+  auto it = itsDictionaries.find(language);
+  if (it == itsDictionaries.end())
+    throw Fmi::Exception(BCP, "Language '" + language + "' is not supported");
+  return it->second;
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Text cache hits and misses of a product
+ *
+ * Products are validated before this is called, so the number of counters
+ * stays small. The counters are never removed, so references stay valid.
+ */
+// ----------------------------------------------------------------------
+
+Plugin::product_cache_stats& Plugin::productCacheStats(const std::string& product)
+{
+  std::lock_guard<std::mutex> lock(itsProductCacheStatsMutex);
+  auto& stats = itsProductCacheStats[product];
+  if (!stats)
+    stats = std::make_unique<product_cache_stats>();
+  return *stats;
+}
+
 Fmi::Cache::CacheStatistics Plugin::getCacheStats() const
 {
   Fmi::Cache::CacheStatistics ret;
 
   ret.insert(std::make_pair("Textgen::forecast_text_cache", itsForecastTextCache.statistics()));
+  ret.insert(std::make_pair("Textgen::forecast_text_cache_bytes",
+                            itsForecastTextCache.byteStatistics()));
+  ret.insert(std::make_pair("Textgen::document_cache", itsDocumentCache.statistics()));
+  ret.insert(std::make_pair("Textgen::wkt_area_cache", itsWktAreaCache.statistics()));
+  ret.insert(std::make_pair("Textgen::location_cache", itsLocationCache.statistics()));
+  ret.insert(
+      std::make_pair("Textgen::forecast_text_coalescing", itsForecastTextInFlight.statistics()));
+  if (itsDiskCache)
+    ret.insert(std::make_pair("Textgen::disk_cache", itsDiskCache->statistics()));
+
+  std::lock_guard<std::mutex> lock(itsProductCacheStatsMutex);
+  for (const auto& item : itsProductCacheStats)
+  {
+    Fmi::Cache::CacheStats stats;
+    stats.starttime = item.second->starttime;
+    stats.hits = item.second->hits;
+    stats.misses = item.second->misses;
+    ret.insert(std::make_pair("Textgen::forecast_text_cache::" + item.first, stats));
+  }
 
   return ret;
 }
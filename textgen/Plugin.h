@@ -1,12 +1,23 @@
 #pragma once
 
 #include "Config.h"
+#include "DiskCache.h"
+#include "SingleFlight.h"
+#include "TextCache.h"
+#include "WorkerPool.h"
 
 #include <macgyver/Cache.h>
 #include <spine/HTTP.h>
 #include <spine/Reactor.h>
 #include <spine/SmartMetPlugin.h>
 #include <textgen/DictionaryFactory.h>
+#include <textgen/Document.h>
+#include <textgen/TextGenerator.h>
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <unordered_set>
 
 namespace SmartMet
 {
@@ -28,6 +39,21 @@ namespace Textgen
 {
 class PluginImpl;
 
+// Area of a WKT location, shared by all requests with the same WKT and radius
+struct wkt_area
+{
+  std::string wkt;
+  double radius = 0;
+  std::string area_id;
+  TextGen::WeatherArea area;
+};
+
+using WktAreaCache = Fmi::Cache::Cache<std::uint64_t, std::shared_ptr<const wkt_area>>;
+
+// Area id and area of each location of a request
+using LocationAreas = std::vector<std::pair<std::string, TextGen::WeatherArea>>;
+using LocationAreasPtr = std::shared_ptr<const LocationAreas>;
+
 class Plugin : public SmartMetPlugin
 {
  public:
@@ -48,22 +74,108 @@ class Plugin : public SmartMetPlugin
                       SmartMet::Spine::HTTP::Response& theResponse) override;
 
  private:
-  std::string query(SmartMet::Spine::Reactor& theReactor,
-                    const SmartMet::Spine::HTTP::Request& theRequest,
-                    SmartMet::Spine::HTTP::Response& theResponse);
-  bool verifyHttpRequestParameters(SmartMet::Spine::HTTP::ParamMap& queryParameters,
+  // Properties of a response in addition to its text
+  struct text_status
+  {
+    bool stale = false;         // some texts were of the previous querydata
+    std::uint64_t hash = 0;     // of the texts, for the ETag
+    std::time_t generated = 0;  // of the newest text, for Last-Modified
+    int max_age = 0;            // seconds the texts stay fresh
+  };
+
+  // Text cache hits and misses of one product
+  struct product_cache_stats
+  {
+    std::atomic<std::size_t> hits{0};
+    std::atomic<std::size_t> misses{0};
+    Fmi::DateTime starttime = Fmi::SecondClock::universal_time();
+  };
+
+  std::vector<TextPtr> query(SmartMet::Spine::Reactor& theReactor,
+                             const SmartMet::Spine::HTTP::Request& theRequest,
+                             SmartMet::Spine::HTTP::Response& theResponse,
+                             text_status& status);
+  std::vector<TextPtr> forecastTexts(const ConfigSnapshotPtr& snapshot,
+                                     const SmartMet::Spine::HTTP::Request& theRequest,
+                                     std::size_t max_workers,
+                                     text_status& status);
+  std::string batchQuery(const SmartMet::Spine::HTTP::Request& theRequest);
+  LocationAreasPtr resolveLocations(const ConfigSnapshot& snapshot,
+                                    const SmartMet::Spine::HTTP::Request& theRequest,
+                                    const std::string& product_name,
+                                    const std::string& language);
+  bool verifyHttpRequestParameters(const ConfigSnapshot& snapshot,
+                                   SmartMet::Spine::HTTP::ParamMap& queryParameters,
                                    std::string& errorMessage);
+  TextPtr areaForecastText(const ProductConfig& config,
+                           TextGen::TextGenerator& generator,
+                           const TextGen::WeatherArea& area,
+                           const TextKey& key,
+                           const std::optional<TextKey>& stale_key,
+                           const std::string& language,
+                           const std::string& formatter_name,
+                           std::time_t data_version,
+                           bool configIsModified,
+                           product_cache_stats& cache_stats,
+                           bool& stale);
+  TextPtr generateAreaText(TextGen::TextGenerator& generator,
+                           const TextGen::WeatherArea& area,
+                           const TextKey& key,
+                           const std::string& language,
+                           const std::string& formatter_name,
+                           std::time_t data_version,
+                           bool configIsModified);
+  void refreshAreaText(const ConfigSnapshotPtr& snapshot,
+                       const std::string& product_name,
+                       const SmartMet::Spine::HTTP::ParamMap& parameters,
+                       const TextGenPosixTime& forecasttime,
+                       const TextGen::WeatherArea& area,
+                       const TextKey& key,
+                       const std::string& language,
+                       const std::string& formatter_name,
+                       std::time_t data_version);
 
   SmartMet::Spine::Reactor* itsReactor = nullptr;
   const std::string itsModuleName;
   Config itsConfig;
-  std::shared_ptr<TextGen::Dictionary> itsDictionary;
+  // One read-only dictionary per supported language, no locking is needed when formatting
+  std::map<std::string, std::shared_ptr<TextGen::Dictionary>> itsDictionaries;
+  const std::shared_ptr<TextGen::Dictionary>& getDictionary(const std::string& language) const;
+
+  TextCache itsForecastTextCache;
 
-  struct cache_item
+  // Generated documents do not depend on the language or the formatter
+  struct document_item
   {
-    std::string member;
+    std::shared_ptr<const TextGen::Document> document;
   };
-  Fmi::Cache::Cache<std::string, cache_item> itsForecastTextCache;
+  Fmi::Cache::Cache<std::string, document_item> itsDocumentCache;
+
+  // Parsed and projected WKT locations by a hash of the WKT and the radius
+  WktAreaCache itsWktAreaCache;
+
+  // Resolved locations by the location parameters of requests and the geometry generation
+  Fmi::Cache::Cache<std::string, LocationAreasPtr> itsLocationCache;
+  std::atomic<std::size_t> itsLocationCacheGeneration{0};
+
+  // Optional persistent cache of texts of monitored querydata
+  std::unique_ptr<DiskCache> itsDiskCache;
+
+  // Threads shared by all requests for generating their areas and batch jobs in parallel
+  std::unique_ptr<WorkerPool> itsAreaPool;
+
+  // Identical concurrent cache misses wait for a single generation
+  SingleFlight<TextPtr, TextKey, TextKeyHash> itsForecastTextInFlight;
+
+  // Statistics of the text caches by product
+  mutable std::mutex itsProductCacheStatsMutex;
+  std::map<std::string, std::unique_ptr<product_cache_stats>> itsProductCacheStats;
+  product_cache_stats& productCacheStats(const std::string& product);
+
+  // Background regeneration of texts which were served stale
+  std::mutex itsRefreshMutex;
+  std::unordered_set<TextKey, TextKeyHash> itsRefreshKeys;
+  std::unique_ptr<WorkerPool> itsRefreshPool;
 
   std::shared_ptr<SmartMet::Engine::Geonames::Engine> itsGeoEngine;
   std::shared_ptr<SmartMet::Engine::Gis::Engine> itsGisEngine;
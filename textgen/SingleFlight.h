@@ -0,0 +1,102 @@
+// ======================================================================
+/*!
+ * \brief Coalescing of identical concurrent computations
+ *
+ * The first caller with a given key runs the computation, later callers
+ * with the same key wait for its result or its exception instead of
+ * repeating the work.
+ */
+// ======================================================================
+
+#pragma once
+
+#include <macgyver/CacheStats.h>
+#include <macgyver/DateTime.h>
+#include <atomic>
+#include <exception>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace SmartMet
+{
+namespace Plugin
+{
+namespace Textgen
+{
+template <typename Value, typename Key = std::string, typename Hash = std::hash<Key>>
+class SingleFlight
+{
+ public:
+  SingleFlight() : itsStartTime(Fmi::SecondClock::universal_time()) {}
+  SingleFlight(const SingleFlight& other) = delete;
+  SingleFlight& operator=(const SingleFlight& other) = delete;
+
+  Value run(const Key& key, const std::function<Value()>& compute)
+  {
+    std::unique_lock<std::mutex> lock(itsMutex);
+
+    auto pos = itsCalls.find(key);
+    if (pos != itsCalls.end())
+    {
+      std::shared_future<Value> result = pos->second;
+      lock.unlock();
+      ++itsCoalescedWaits;
+      return result.get();
+    }
+
+    std::promise<Value> promise;
+    itsCalls.insert(std::make_pair(key, promise.get_future().share()));
+    lock.unlock();
+    ++itsComputations;
+
+    try
+    {
+      Value value = compute();
+      promise.set_value(value);
+      finish(key);
+      return value;
+    }
+    catch (...)
+    {
+      promise.set_exception(std::current_exception());
+      finish(key);
+      throw;
+    }
+  }
+
+  // Hits are coalesced waits, misses are computations actually run
+  Fmi::Cache::CacheStats statistics() const
+  {
+    Fmi::Cache::CacheStats stats;
+    stats.starttime = itsStartTime;
+    {
+      std::lock_guard<std::mutex> lock(itsMutex);
+      stats.size = itsCalls.size();
+    }
+    stats.hits = itsCoalescedWaits;
+    stats.misses = itsComputations;
+    return stats;
+  }
+
+ private:
+  void finish(const Key& key)
+  {
+    std::lock_guard<std::mutex> lock(itsMutex);
+    itsCalls.erase(key);
+  }
+
+  mutable std::mutex itsMutex;
+  std::unordered_map<Key, std::shared_future<Value>, Hash> itsCalls;
+  std::atomic<std::size_t> itsCoalescedWaits{0};
+  std::atomic<std::size_t> itsComputations{0};
+  Fmi::DateTime itsStartTime;
+};
+
+}  // namespace Textgen
+}  // namespace Plugin
+}  // namespace SmartMet
+
+// ======================================================================
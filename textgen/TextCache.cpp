@@ -0,0 +1,215 @@
+// ======================================================================
+/*!
+ * \brief Implementation of class TextCache
+ */
+// ======================================================================
+
+#include "TextCache.h"
+#include <macgyver/Exception.h>
+#include <algorithm>
+#include <mutex>
+#include <set>
+#include <unordered_map>
+#include <utility>
+
+namespace SmartMet
+{
+namespace Plugin
+{
+namespace Textgen
+{
+namespace
+{
+// Approximate bookkeeping overhead of one text in addition to the key and the value
+const std::size_t entry_overhead = 128;
+}  // namespace
+
+TextPtr make_text(std::string text, std::time_t generated, bool precompress)
+{
+  try
+  {
+    auto ret = std::make_shared<CachedText>();
+    ret->hash = stable_hash(text);
+    ret->generated = generated;
+    if (precompress)
+      ret->deflated = deflate_text(text);
+    ret->text = std::move(text);
+    return ret;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// One independently locked part of the cache
+struct TextCache::shard
+{
+  struct entry
+  {
+    TextPtr value;
+    std::size_t bytes = 0;
+    double cost = 0;
+    double priority = 0;
+  };
+
+  void prioritize(const TextKey& key, entry& e);
+  void evict();
+
+  std::mutex mutex;
+  std::unordered_map<TextKey, entry, TextKeyHash> entries;
+  // Priority and the key stored in entries, whose address is stable
+  std::set<std::pair<double, const TextKey*>> queue;
+  double inflation = 0;
+  std::size_t bytes = 0;
+  std::size_t max_bytes = 0;
+
+  std::size_t hits = 0;
+  std::size_t misses = 0;
+  std::size_t inserts = 0;
+};
+
+// Restore the priority of a text which was used again
+void TextCache::shard::prioritize(const TextKey& key, entry& e)
+{
+  queue.erase(std::make_pair(e.priority, &key));
+  e.priority = inflation + e.cost / static_cast<double>(e.bytes);
+  queue.insert(std::make_pair(e.priority, &key));
+}
+
+void TextCache::shard::evict()
+{
+  while (bytes > max_bytes && !queue.empty())
+  {
+    auto victim = queue.begin();
+    inflation = victim->first;
+
+    auto pos = entries.find(*victim->second);
+    bytes -= pos->second.bytes;
+    queue.erase(victim);
+    entries.erase(pos);
+  }
+}
+
+TextCache::TextCache(std::size_t shards) : itsStartTime(Fmi::SecondClock::universal_time())
+{
+  for (std::size_t i = 0; i < std::max<std::size_t>(1, shards); i++)
+    itsShards.emplace_back(std::make_unique<shard>());
+}
+
+TextCache::~TextCache() = default;
+
+TextCache::shard& TextCache::shardOf(const TextKey& key) const
+{
+  return *itsShards[key.secondaryHash() % itsShards.size()];
+}
+
+void TextCache::resize(std::size_t max_bytes)
+{
+  for (auto& s : itsShards)
+  {
+    std::lock_guard<std::mutex> lock(s->mutex);
+    s->max_bytes = max_bytes / itsShards.size();
+    s->evict();
+  }
+}
+
+TextPtr TextCache::find(const TextKey& key)
+{
+  try
+  {
+    shard& s = shardOf(key);
+    std::lock_guard<std::mutex> lock(s.mutex);
+
+    auto pos = s.entries.find(key);
+    if (pos == s.entries.end())
+    {
+      ++s.misses;
+      return {};
+    }
+
+    ++s.hits;
+    s.prioritize(pos->first, pos->second);
+    return pos->second.value;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+void TextCache::insert(const TextKey& key, const TextPtr& value, double cost)
+{
+  try
+  {
+    std::size_t bytes = key.size() + value->text.size() + entry_overhead;
+    if (value->deflated)
+      bytes += value->deflated->data.size();
+
+    shard& s = shardOf(key);
+    std::lock_guard<std::mutex> lock(s.mutex);
+
+    if (bytes > s.max_bytes)
+      return;
+
+    auto pos = s.entries.find(key);
+    if (pos != s.entries.end())
+    {
+      s.queue.erase(std::make_pair(pos->second.priority, &pos->first));
+      s.bytes -= pos->second.bytes;
+      s.entries.erase(pos);
+    }
+
+    pos = s.entries.insert(std::make_pair(key, shard::entry())).first;
+    auto& e = pos->second;
+    e.value = value;
+    e.bytes = bytes;
+    e.cost = cost;
+    s.bytes += bytes;
+    ++s.inserts;
+
+    e.priority = s.inflation + e.cost / static_cast<double>(e.bytes);
+    s.queue.insert(std::make_pair(e.priority, &pos->first));
+
+    s.evict();
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// Totals over all shards
+Fmi::Cache::CacheStats TextCache::statistics() const
+{
+  Fmi::Cache::CacheStats stats;
+  stats.starttime = itsStartTime;
+  for (const auto& s : itsShards)
+  {
+    std::lock_guard<std::mutex> lock(s->mutex);
+    stats.maxsize += s->max_bytes;
+    stats.size += s->entries.size();
+    stats.hits += s->hits;
+    stats.misses += s->misses;
+    stats.inserts += s->inserts;
+  }
+  return stats;
+}
+
+Fmi::Cache::CacheStats TextCache::byteStatistics() const
+{
+  Fmi::Cache::CacheStats stats = statistics();
+  stats.size = 0;
+  for (const auto& s : itsShards)
+  {
+    std::lock_guard<std::mutex> lock(s->mutex);
+    stats.size += s->bytes;
+  }
+  return stats;
+}
+
+}  // namespace Textgen
+}  // namespace Plugin
+}  // namespace SmartMet
+
+// ======================================================================
@@ -0,0 +1,83 @@
+// ======================================================================
+/*!
+ * \brief Byte limited cache of formatted texts
+ *
+ * Texts vary from a single line to large HTML documents for many areas,
+ * so the cache is limited by total bytes instead of the number of texts.
+ * Eviction follows the GreedyDual-Size policy: each text has the priority
+ * L + cost / size, where cost is the time it took to produce the text and
+ * L is the priority of the most recently evicted text. Small texts which
+ * were slow to generate are kept longest, and texts which are not used
+ * age out as L grows.
+ *
+ * The cache is split into shards by a hash of the key, each with its own
+ * lock and an equal share of the byte limit, so that concurrent requests
+ * seldom wait for each other.
+ */
+// ======================================================================
+
+#pragma once
+
+#include "Compression.h"
+#include "TextKey.h"
+#include <boost/noncopyable.hpp>
+#include <macgyver/CacheStats.h>
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace SmartMet
+{
+namespace Plugin
+{
+namespace Textgen
+{
+struct CachedText
+{
+  std::string text;
+  std::uint64_t hash = 0;                // of the text, for ETags
+  std::time_t generated = 0;             // for Last-Modified
+  std::optional<DeflatedText> deflated;  // if precompression is enabled
+};
+
+// Cached texts are shared by all requests and never modified
+using TextPtr = std::shared_ptr<const CachedText>;
+
+TextPtr make_text(std::string text, std::time_t generated, bool precompress);
+
+class TextCache : private boost::noncopyable
+{
+ public:
+  explicit TextCache(std::size_t shards = 16);
+  ~TextCache();
+
+  void resize(std::size_t max_bytes);
+
+  // Returns an empty pointer if the text is not cached
+  TextPtr find(const TextKey& key);
+  // Cost is the time in seconds it took to produce the text
+  void insert(const TextKey& key, const TextPtr& value, double cost);
+
+  // Size in number of texts. The number is not limited, so the maximum size is the byte limit.
+  Fmi::Cache::CacheStats statistics() const;
+  // Sizes in bytes
+  Fmi::Cache::CacheStats byteStatistics() const;
+
+ private:
+  struct shard;
+
+  shard& shardOf(const TextKey& key) const;
+
+  std::vector<std::unique_ptr<shard>> itsShards;
+  Fmi::DateTime itsStartTime;
+};
+
+}  // namespace Textgen
+}  // namespace Plugin
+}  // namespace SmartMet
+
+// ======================================================================
@@ -0,0 +1,182 @@
+// ======================================================================
+/*!
+ * \brief Implementation of classes TextKey and TextKeyPrefix
+ */
+// ======================================================================
+
+#include "TextKey.h"
+#include <macgyver/Exception.h>
+#include <macgyver/StringConversion.h>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string_view>
+#include <unordered_map>
+
+namespace SmartMet
+{
+namespace Plugin
+{
+namespace Textgen
+{
+namespace
+{
+// Product, language and formatter names are validated before keys are made,
+// so the number of interned names stays small
+struct name_table
+{
+  std::mutex mutex;
+  std::unordered_map<std::string, std::uint32_t> ids;
+  std::deque<std::string> names;  // references stay valid when names are added
+};
+
+name_table& interned_names()
+{
+  static name_table instance;
+  return instance;
+}
+
+std::uint32_t intern(const std::string& name)
+{
+  auto& n = interned_names();
+  std::lock_guard<std::mutex> lock(n.mutex);
+  auto pos = n.ids.find(name);
+  if (pos != n.ids.end())
+    return pos->second;
+
+  const auto id = static_cast<std::uint32_t>(n.names.size());
+  n.names.push_back(name);
+  n.ids.insert(std::make_pair(name, id));
+  return id;
+}
+
+const std::string& interned_name(std::uint32_t id)
+{
+  auto& n = interned_names();
+  std::lock_guard<std::mutex> lock(n.mutex);
+  return n.names.at(id);
+}
+
+}  // namespace
+
+// FNV-1a
+std::uint64_t stable_hash(std::string_view text)
+{
+  std::uint64_t h = 14695981039346656037ULL;
+  for (unsigned char ch : text)
+  {
+    h ^= ch;
+    h *= 1099511628211ULL;
+  }
+  return h;
+}
+
+// Finalized with splitmix64
+std::uint64_t stable_hash_combine(std::uint64_t seed, std::uint64_t value)
+{
+  std::uint64_t h = seed ^ (value + 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2));
+  h ^= h >> 30;
+  h *= 0xbf58476d1ce4e5b9ULL;
+  h ^= h >> 27;
+  h *= 0x94d049bb133111ebULL;
+  h ^= h >> 31;
+  return h;
+}
+
+bool TextKey::operator==(const TextKey& other) const
+{
+  // Keys with different hashes are never equal, so the variable parts are
+  // compared only for the rare keys whose hashes are the same
+  if (itsHash[0] != other.itsHash[0] || itsHash[1] != other.itsHash[1] ||
+      itsProduct != other.itsProduct || itsLanguage != other.itsLanguage ||
+      itsFormatter != other.itsFormatter || itsIsPoint != other.itsIsPoint)
+    return false;
+
+  if (itsAreaId != other.itsAreaId && *itsAreaId != *other.itsAreaId)
+    return false;
+
+  return (itsVariablePart == other.itsVariablePart || *itsVariablePart == *other.itsVariablePart);
+}
+
+std::string TextKey::documentKey() const
+{
+  try
+  {
+    return interned_name(itsProduct) + ";" + *itsVariablePart + ";" + *itsAreaId + ";" +
+           Fmi::to_string(itsIsPoint);
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+std::string TextKey::str() const
+{
+  try
+  {
+    return documentKey() + ";" + interned_name(itsLanguage) + ";" + interned_name(itsFormatter);
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+std::size_t TextKey::size() const
+{
+  // The strings are shared, count them anyway since they may outlive the request
+  return sizeof(TextKey) + itsAreaId->size() + itsVariablePart->size();
+}
+
+TextKeyPrefix::TextKeyPrefix(const std::string& product,
+                             const std::string& language,
+                             const std::string& formatter,
+                             std::string variable_part)
+    : itsProduct(intern(product)),
+      itsLanguage(intern(language)),
+      itsFormatter(intern(formatter)),
+      itsVariablePart(std::make_shared<const std::string>(std::move(variable_part)))
+{
+  try
+  {
+    const std::uint64_t ids = (static_cast<std::uint64_t>(itsProduct) << 40) ^
+                              (static_cast<std::uint64_t>(itsLanguage) << 20) ^ itsFormatter;
+
+    // The two halves of the 128-bit hash come from different hash functions
+    itsHash[0] = stable_hash_combine(std::hash<std::string_view>()(*itsVariablePart), ids);
+    itsHash[1] = stable_hash_combine(stable_hash(*itsVariablePart), ids);
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+TextKey TextKeyPrefix::key(const std::string& area_id, bool is_point) const
+{
+  try
+  {
+    TextKey key;
+    key.itsProduct = itsProduct;
+    key.itsLanguage = itsLanguage;
+    key.itsFormatter = itsFormatter;
+    key.itsIsPoint = is_point;
+    key.itsVariablePart = itsVariablePart;
+    key.itsAreaId = std::make_shared<const std::string>(area_id);
+    key.itsHash[0] =
+        stable_hash_combine(itsHash[0], std::hash<std::string_view>()(area_id) + is_point);
+    key.itsHash[1] = stable_hash_combine(itsHash[1], stable_hash(area_id) + is_point);
+    return key;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+}  // namespace Textgen
+}  // namespace Plugin
+}  // namespace SmartMet
+
+// ======================================================================
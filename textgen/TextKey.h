@@ -0,0 +1,91 @@
+// ======================================================================
+/*!
+ * \brief Compact keys of formatted texts
+ *
+ * The parts of a text key which do not depend on the area, including the
+ * possibly very long modified settings and WKT, are hashed only once per
+ * request into a TextKeyPrefix. The key of each area is then a fixed size
+ * value of interned ids and a 128-bit hash. The variable parts are kept
+ * only for the exact comparison done when two keys have the same hash.
+ * Area ids are too many to intern globally, so each key refers to its id
+ * through a shared pointer, and copies of the key share the same string.
+ */
+// ======================================================================
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+
+namespace SmartMet
+{
+namespace Plugin
+{
+namespace Textgen
+{
+// Hashes which are the same in all processes, so that servers agree on ETags
+std::uint64_t stable_hash(std::string_view text);
+std::uint64_t stable_hash_combine(std::uint64_t seed, std::uint64_t value);
+
+class TextKey
+{
+ public:
+  bool operator==(const TextKey& other) const;
+  bool operator!=(const TextKey& other) const { return !(*this == other); }
+
+  std::size_t hash() const { return static_cast<std::size_t>(itsHash[0]); }
+  // Independent of hash(), for choosing a cache shard
+  std::size_t secondaryHash() const { return static_cast<std::size_t>(itsHash[1]); }
+
+  // Key of the generated document, which is the same for all languages and formatters
+  std::string documentKey() const;
+  // Full key as a string, used where the key is persisted. Starts with the product name.
+  std::string str() const;
+
+  // Approximate memory used by the key
+  std::size_t size() const;
+
+ private:
+  friend class TextKeyPrefix;
+
+  std::uint32_t itsProduct = 0;
+  std::uint32_t itsLanguage = 0;
+  std::uint32_t itsFormatter = 0;
+  bool itsIsPoint = false;
+  std::uint64_t itsHash[2] = {0, 0};
+  std::shared_ptr<const std::string> itsVariablePart;  // shared by all areas of a request
+  std::shared_ptr<const std::string> itsAreaId;        // shared by the copies of the key
+};
+
+struct TextKeyHash
+{
+  std::size_t operator()(const TextKey& key) const { return key.hash(); }
+};
+
+// The area independent part of the keys of one request
+class TextKeyPrefix
+{
+ public:
+  TextKeyPrefix(const std::string& product,
+                const std::string& language,
+                const std::string& formatter,
+                std::string variable_part);
+
+  TextKey key(const std::string& area_id, bool is_point) const;
+
+ private:
+  std::uint32_t itsProduct = 0;
+  std::uint32_t itsLanguage = 0;
+  std::uint32_t itsFormatter = 0;
+  std::uint64_t itsHash[2] = {0, 0};
+  std::shared_ptr<const std::string> itsVariablePart;
+};
+
+}  // namespace Textgen
+}  // namespace Plugin
+}  // namespace SmartMet
+
+// ======================================================================
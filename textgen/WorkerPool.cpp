@@ -0,0 +1,108 @@
+// ======================================================================
+/*!
+ * \brief Implementation of class WorkerPool
+ */
+// ======================================================================
+
+#include "WorkerPool.h"
+#include <macgyver/Exception.h>
+#include <algorithm>
+
+namespace SmartMet
+{
+namespace Plugin
+{
+namespace Textgen
+{
+WorkerPool::WorkerPool(const std::string& name, std::size_t workers, std::size_t max_queue)
+    : itsMaxQueue(max_queue)
+{
+  try
+  {
+    for (std::size_t i = 0; i < std::max<std::size_t>(1, workers); i++)
+      itsWorkers.emplace_back(std::make_unique<Fmi::AsyncTask>(name, [this]() { run(); }));
+  }
+  catch (...)
+  {
+    shutdown();
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+WorkerPool::~WorkerPool()
+{
+  shutdown();
+}
+
+bool WorkerPool::submit(std::function<void()> task)
+{
+  {
+    std::lock_guard<std::mutex> lock(itsMutex);
+    if (itsStopping || itsQueue.size() >= itsMaxQueue)
+      return false;
+    itsQueue.push_back(std::move(task));
+  }
+  itsCondition.notify_one();
+  return true;
+}
+
+void WorkerPool::shutdown()
+{
+  {
+    std::lock_guard<std::mutex> lock(itsMutex);
+    itsStopping = true;
+    itsQueue.clear();
+  }
+  itsCondition.notify_all();
+
+  for (auto& worker : itsWorkers)
+  {
+    try
+    {
+      worker->cancel();
+      worker->wait();
+    }
+    catch (...)
+    {
+      // The tasks report their own errors
+    }
+  }
+  itsWorkers.clear();
+}
+
+std::size_t WorkerPool::queueSize() const
+{
+  std::lock_guard<std::mutex> lock(itsMutex);
+  return itsQueue.size();
+}
+
+void WorkerPool::run()
+{
+  while (true)
+  {
+    std::function<void()> task;
+    {
+      std::unique_lock<std::mutex> lock(itsMutex);
+      itsCondition.wait(lock, [this]() { return itsStopping || !itsQueue.empty(); });
+      if (itsStopping)
+        return;
+      task = std::move(itsQueue.front());
+      itsQueue.pop_front();
+    }
+
+    try
+    {
+      task();
+    }
+    catch (...)
+    {
+      Fmi::Exception::Trace(BCP, "Worker task failed").printError();
+    }
+  }
+}
+
+}  // namespace Textgen
+}  // namespace Plugin
+}  // namespace SmartMet
+
+// ======================================================================
@@ -0,0 +1,60 @@
+// ======================================================================
+/*!
+ * \brief Fixed number of worker threads shared by all requests
+ *
+ * Tasks are queued up to a limit, beyond which they are rejected so that
+ * the caller can run the work itself or drop it. The threads are long
+ * lived, hence the textgen settings they install are reused by later
+ * tasks of the same product.
+ */
+// ======================================================================
+
+#pragma once
+
+#include <boost/noncopyable.hpp>
+#include <macgyver/AsyncTask.h>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace SmartMet
+{
+namespace Plugin
+{
+namespace Textgen
+{
+class WorkerPool : private boost::noncopyable
+{
+ public:
+  WorkerPool(const std::string& name, std::size_t workers, std::size_t max_queue);
+  ~WorkerPool();
+
+  // Returns false if the queue is full or the pool has been shut down
+  bool submit(std::function<void()> task);
+
+  // Discard the queued tasks and wait for the running ones
+  void shutdown();
+
+  std::size_t queueSize() const;
+
+ private:
+  void run();
+
+  const std::size_t itsMaxQueue;
+  mutable std::mutex itsMutex;
+  std::condition_variable itsCondition;
+  std::deque<std::function<void()>> itsQueue;
+  bool itsStopping = false;
+  std::vector<std::unique_ptr<Fmi::AsyncTask>> itsWorkers;
+};
+
+}  // namespace Textgen
+}  // namespace Plugin
+}  // namespace SmartMet
+
+// ======================================================================
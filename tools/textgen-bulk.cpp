@@ -0,0 +1,286 @@
+// ======================================================================
+/*!
+ * \brief Generate the texts of many products, areas and languages to disk
+ *
+ * Usage: textgen-bulk [options] <reactor.conf> <joblist> <outputdir>
+ *
+ * The reactor configuration loads the textgen plugin and the engines it
+ * needs, just like the server does. Each line of the job list is of the
+ * form
+ *
+ *   product;area[,area...];language[,language...];formatter[,formatter...]
+ *
+ * and stands for all combinations of the listed areas, languages and
+ * formatters. Empty lines and lines starting with '#' are ignored. The
+ * text of each job is written to outputdir/product/language/formatter/area
+ * so that readers never see a partially written file. Separators, control
+ * characters, '%' and names of only dots are percent-encoded in the path.
+ */
+// ======================================================================
+
+#include <boost/algorithm/string.hpp>
+#include <macgyver/Exception.h>
+#include <macgyver/StringConversion.h>
+#include <spine/HTTP.h>
+#include <spine/Reactor.h>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace
+{
+struct Job
+{
+  std::string product;
+  std::string area;
+  std::string language;
+  std::string formatter;
+};
+
+struct Options
+{
+  std::string reactorconfig;
+  std::string joblist;
+  std::string outputdir;
+  std::string url = "/textgen";
+  unsigned int threads = std::max(1U, std::thread::hardware_concurrency());
+};
+
+void usage()
+{
+  std::cerr << "Usage: textgen-bulk [-j threads] [-u url] <reactor.conf> <joblist> <outputdir>\n";
+}
+
+bool parse_options(int argc, char* argv[], Options& options)
+{
+  std::vector<std::string> args;
+  for (int i = 1; i < argc; i++)
+  {
+    std::string arg(argv[i]);
+    if ((arg == "-j" || arg == "-u") && i + 1 < argc)
+    {
+      if (arg == "-j")
+        options.threads = std::max(1UL, std::stoul(argv[++i]));
+      else
+        options.url = argv[++i];
+    }
+    else if (arg == "-h" || arg == "--help")
+      return false;
+    else
+      args.push_back(arg);
+  }
+  if (args.size() != 3)
+    return false;
+
+  options.reactorconfig = args[0];
+  options.joblist = args[1];
+  options.outputdir = args[2];
+  return true;
+}
+
+std::vector<std::string> split_list(const std::string& list)
+{
+  std::vector<std::string> parts;
+  boost::algorithm::split(parts, list, boost::algorithm::is_any_of(","));
+  for (auto& part : parts)
+    boost::algorithm::trim(part);
+  return parts;
+}
+
+std::vector<Job> read_jobs(const std::string& filename)
+{
+  std::ifstream in(filename);
+  if (!in)
+    throw Fmi::Exception(BCP, "Failed to open job list '" + filename + "'");
+
+  std::vector<Job> jobs;
+  std::string line;
+  std::size_t line_number = 0;
+  while (std::getline(in, line))
+  {
+    ++line_number;
+    boost::algorithm::trim(line);
+    if (line.empty() || line[0] == '#')
+      continue;
+
+    std::vector<std::string> fields;
+    boost::algorithm::split(fields, line, boost::algorithm::is_any_of(";"));
+    if (fields.size() != 4)
+      throw Fmi::Exception(BCP, "Invalid job on line " + Fmi::to_string(line_number))
+          .addParameter("Expected", "product;areas;languages;formatters");
+
+    const std::string product = boost::algorithm::trim_copy(fields[0]);
+    for (const auto& area : split_list(fields[1]))
+      for (const auto& language : split_list(fields[2]))
+        for (const auto& formatter : split_list(fields[3]))
+          jobs.push_back(Job{product, area, language, formatter});
+  }
+  return jobs;
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief A single path component for a name
+ *
+ * Separators, control characters and the escape character itself are
+ * percent-encoded, as are names which consist only of dots, so that
+ * different names never map to the same file and no name can step out
+ * of the output directory. UTF-8 area names are kept readable.
+ */
+// ----------------------------------------------------------------------
+
+std::string file_name(const std::string& name)
+{
+  if (name.empty())
+    throw Fmi::Exception(BCP, "Empty names cannot be used as file names");
+
+  const bool only_dots = (name.find_first_not_of('.') == std::string::npos);
+
+  std::string ret;
+  ret.reserve(name.size());
+  for (char ch : name)
+  {
+    const auto uch = static_cast<unsigned char>(ch);
+    if (uch < 0x20 || uch == 0x7f || ch == '/' || ch == '\\' || ch == '%' ||
+        (only_dots && ch == '.'))
+    {
+      char encoded[4];
+      std::snprintf(encoded, sizeof(encoded), "%%%02X", static_cast<unsigned int>(uch));
+      ret += encoded;
+    }
+    else
+      ret += ch;
+  }
+  return ret;
+}
+
+// Write to a temporary file first and rename it to replace the old file atomically
+void write_atomically(const std::filesystem::path& path, const std::string& content)
+{
+  std::filesystem::create_directories(path.parent_path());
+
+  std::filesystem::path tmp = path;
+  tmp += ".tmp." + Fmi::to_string(getpid()) + "." +
+         Fmi::to_string(std::hash<std::thread::id>()(std::this_thread::get_id()));
+  {
+    std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+    out << content;
+    out.close();
+    if (!out)
+      throw Fmi::Exception(BCP, "Failed to write '" + tmp.string() + "'");
+  }
+  std::filesystem::rename(tmp, path);
+}
+
+}  // namespace
+
+int main(int argc, char* argv[])
+try
+{
+  Options options;
+  if (!parse_options(argc, argv, options))
+  {
+    usage();
+    return 1;
+  }
+
+  const std::vector<Job> jobs = read_jobs(options.joblist);
+
+  SmartMet::Spine::Options reactor_options;
+  reactor_options.configfile = options.reactorconfig;
+  reactor_options.quiet = true;
+  reactor_options.defaultlogging = false;
+  reactor_options.parseConfig();
+
+  SmartMet::Spine::Reactor reactor(reactor_options);
+  reactor.init();
+
+  const auto start_time = std::chrono::steady_clock::now();
+
+  // Jobs are taken from the shared list one at a time, so a thread which
+  // finishes early simply takes more of them
+  std::atomic<std::size_t> next_job{0};
+  std::atomic<std::size_t> failed_jobs{0};
+  std::atomic<std::size_t> written_bytes{0};
+
+  auto run_jobs = [&]()
+  {
+    for (std::size_t i = next_job++; i < jobs.size(); i = next_job++)
+    {
+      const Job& job = jobs[i];
+      try
+      {
+        SmartMet::Spine::HTTP::Request request;
+        request.setMethod("GET");
+        request.setResource(options.url);
+        request.setParameter("product", job.product);
+        request.setParameter("area", job.area);
+        request.setParameter("language", job.language);
+        request.setParameter("formatter", job.formatter);
+
+        auto handler = reactor.getHandlerView(request);
+        if (!handler)
+          throw Fmi::Exception(BCP, "No handler for url '" + options.url + "'");
+
+        SmartMet::Spine::HTTP::Response response;
+        handler->handle(reactor, request, response);
+
+        if (response.getStatus() != SmartMet::Spine::HTTP::Status::ok)
+          throw Fmi::Exception(BCP, response.getHeader("X-TextGen-Error").value_or("Failed"));
+
+        const std::string text = response.getContent();
+        write_atomically(std::filesystem::path(options.outputdir) / file_name(job.product) /
+                             file_name(job.language) / file_name(job.formatter) /
+                             file_name(job.area),
+                         text);
+        written_bytes += text.size();
+      }
+      catch (...)
+      {
+        ++failed_jobs;
+        Fmi::Exception exception(BCP, "Job failed", nullptr);
+        std::cerr << job.product << ";" << job.area << ";" << job.language << ";"
+                  << job.formatter << ": " << exception.what() << '\n';
+      }
+    }
+  };
+
+  const std::size_t thread_count = std::min<std::size_t>(options.threads, jobs.size());
+  std::vector<std::thread> threads;
+  for (std::size_t i = 1; i < thread_count; i++)
+    threads.emplace_back(run_jobs);
+  run_jobs();
+  for (auto& thread : threads)
+    thread.join();
+
+  const double seconds =
+      std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+  const std::size_t done = jobs.size() - failed_jobs;
+
+  std::cout << "Jobs:       " << jobs.size() << " (" << failed_jobs << " failed)\n"
+            << "Threads:    " << std::max<std::size_t>(1, thread_count) << '\n'
+            << "Bytes:      " << written_bytes << '\n'
+            << "Time:       " << seconds << " s\n";
+  if (seconds > 0)
+    std::cout << "Throughput: " << done / seconds << " texts/s, "
+              << written_bytes / seconds / 1024 / 1024 << " MiB/s\n";
+
+  reactor.shutdown();
+
+  return (failed_jobs > 0 ? 2 : 0);
+}
+catch (...)
+{
+  Fmi::Exception::Trace(BCP, "textgen-bulk failed").printError();
+  return 1;
+}
+
+// ======================================================================